@@ -0,0 +1,460 @@
+//External includes
+#include "SDL.h"
+#undef main
+
+//Standard includes
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//Project includes
+#include "CameraPath.h"
+#include "Profiler.h"
+#include "Renderer.h"
+
+using namespace dae;
+
+//Replays a camera path headless for a fixed number of frames per resolution and reports frame times per stage as JSON
+//The same path is replayed once more through the depth only rasterizer, reported separately
+//Every resolution is measured once per light count, with the lights spread over the instances
+//Usage: RasterizerBenchmark.exe [--frames N] [--warmup N] [--resolution WxH]... [--path file] [--out file] [--trace file] [--no-lazy-clear] [--latency 0|1] [--depth-format f32|d24|d16] [--no-depth-compression] [--instances CxR] [--no-occlusion-culling] [--reference-specular] [--lights N]... [--no-light-culling] [--shading-rate full|2x2|4x4|adaptive] [--target-frame-time ms] [--no-incremental] [--msaa] [--fxaa]
+
+namespace
+{
+	struct Resolution
+	{
+		int width{};
+		int height{};
+	};
+
+	struct StageResult
+	{
+		float min{};
+		float median{};
+		float p99{};
+	};
+
+	struct BenchmarkSettings
+	{
+		int nrFrames{ 300 };
+		int nrWarmupFrames{ 10 };
+		std::vector<Resolution> resolutions{};
+		std::string pathFile{};
+		std::string outputFile{ "Rasterizer_Benchmark.json" };
+		std::string traceFile{};
+		bool useLazyClear{ true };
+		int frameLatency{ 0 };
+		DepthFormat depthFormat{ DepthFormat::Float32 };
+		bool useDepthCompression{ true };
+		int nrInstanceColumns{ 1 };
+		int nrInstanceRows{ 1 };
+		bool useOcclusionCulling{ true };
+		bool useFastSpecular{ true };
+		std::vector<int> lightCounts{};
+		bool useLightCulling{ true };
+		Renderer::ShadingRatePolicy shadingRatePolicy{ Renderer::ShadingRatePolicy::Full };
+		//Enables dynamic resolution when above zero
+		float targetFrameTime{};
+		bool useIncrementalRendering{ true };
+		bool useMsaa{ false };
+		bool useFxaa{ false };
+	};
+
+	const char* depthFormatNames[]{ "f32", "d24", "d16" };
+	const char* shadingRatePolicyNames[]{ "full", "2x2", "4x4", "adaptive" };
+
+	//Quoted JSON string, paths on Windows are full of backslashes
+	std::string ToJsonString(const std::string& value)
+	{
+		std::string result{ "\"" };
+		for (const char character : value)
+		{
+			switch (character)
+			{
+			case '"':
+				result += "\\\"";
+				break;
+			case '\\':
+				result += "\\\\";
+				break;
+			case '\n':
+				result += "\\n";
+				break;
+			case '\r':
+				result += "\\r";
+				break;
+			case '\t':
+				result += "\\t";
+				break;
+			default:
+				//Other control characters have no short escape
+				if (static_cast<unsigned char>(character) < 0x20)
+				{
+					const char* digits{ "0123456789abcdef" };
+					result += "\\u00";
+					result += digits[character >> 4];
+					result += digits[character & 0xf];
+				}
+				else
+					result += character;
+				break;
+			}
+		}
+		return result + "\"";
+	}
+
+	StageResult Summarize(std::vector<float>& samples)
+	{
+		if (samples.empty())
+			return {};
+
+		std::sort(samples.begin(), samples.end());
+
+		const size_t medianIndex{ samples.size() / 2 };
+		const size_t p99Index{ std::min(samples.size() - 1, static_cast<size_t>(samples.size() * 0.99f)) };
+
+		return { samples.front(), samples[medianIndex], samples[p99Index] };
+	}
+
+	bool ParseArguments(int argc, char* args[], BenchmarkSettings& settings)
+	{
+		for (int i{ 1 }; i < argc; ++i)
+		{
+			const std::string argument{ args[i] };
+			const bool hasValue{ i + 1 < argc };
+
+			if (argument == "--frames" && hasValue)
+				settings.nrFrames = std::max(1, std::stoi(args[++i]));
+			else if (argument == "--warmup" && hasValue)
+				settings.nrWarmupFrames = std::max(0, std::stoi(args[++i]));
+			else if (argument == "--path" && hasValue)
+				settings.pathFile = args[++i];
+			else if (argument == "--out" && hasValue)
+				settings.outputFile = args[++i];
+			else if (argument == "--trace" && hasValue)
+				settings.traceFile = args[++i];
+			else if (argument == "--no-lazy-clear")
+				settings.useLazyClear = false;
+			else if (argument == "--latency" && hasValue)
+			{
+				settings.frameLatency = std::stoi(args[++i]);
+				if (settings.frameLatency < 0 || settings.frameLatency > Renderer::GetMaxFrameLatency())
+				{
+					std::cout << "Invalid frame latency: " << args[i] << " (0 to " << Renderer::GetMaxFrameLatency() << ")" << std::endl;
+					return false;
+				}
+			}
+			else if (argument == "--no-depth-compression")
+				settings.useDepthCompression = false;
+			else if (argument == "--no-occlusion-culling")
+				settings.useOcclusionCulling = false;
+			else if (argument == "--no-light-culling")
+				settings.useLightCulling = false;
+			else if (argument == "--reference-specular")
+				settings.useFastSpecular = false;
+			else if (argument == "--no-incremental")
+				settings.useIncrementalRendering = false;
+			else if (argument == "--msaa")
+				settings.useMsaa = true;
+			else if (argument == "--fxaa")
+				settings.useFxaa = true;
+			else if (argument == "--target-frame-time" && hasValue)
+				settings.targetFrameTime = std::max(0.0f, std::stof(args[++i]));
+			else if (argument == "--lights" && hasValue)
+				settings.lightCounts.push_back(std::max(0, std::stoi(args[++i])));
+			else if (argument == "--instances" && hasValue)
+			{
+				char separator{};
+				std::istringstream value{ args[++i] };
+				if (!(value >> settings.nrInstanceColumns >> separator >> settings.nrInstanceRows) || settings.nrInstanceColumns <= 0 || settings.nrInstanceRows <= 0)
+				{
+					std::cout << "Invalid instance grid: " << args[i] << std::endl;
+					return false;
+				}
+			}
+			else if (argument == "--depth-format" && hasValue)
+			{
+				const std::string value{ args[++i] };
+				const auto it{ std::find(std::begin(depthFormatNames), std::end(depthFormatNames), value) };
+				if (it == std::end(depthFormatNames))
+				{
+					std::cout << "Invalid depth format: " << value << std::endl;
+					return false;
+				}
+				settings.depthFormat = static_cast<DepthFormat>(it - std::begin(depthFormatNames));
+			}
+			else if (argument == "--shading-rate" && hasValue)
+			{
+				const std::string value{ args[++i] };
+				const auto it{ std::find(std::begin(shadingRatePolicyNames), std::end(shadingRatePolicyNames), value) };
+				if (it == std::end(shadingRatePolicyNames))
+				{
+					std::cout << "Invalid shading rate: " << value << std::endl;
+					return false;
+				}
+				settings.shadingRatePolicy = static_cast<Renderer::ShadingRatePolicy>(it - std::begin(shadingRatePolicyNames));
+			}
+			else if (argument == "--resolution" && hasValue)
+			{
+				Resolution resolution{};
+				char separator{};
+				std::istringstream value{ args[++i] };
+				if (!(value >> resolution.width >> separator >> resolution.height) || resolution.width <= 0 || resolution.height <= 0)
+				{
+					std::cout << "Invalid resolution: " << args[i] << std::endl;
+					return false;
+				}
+				settings.resolutions.push_back(resolution);
+			}
+			else
+			{
+				std::cout << "Unknown argument: " << argument << std::endl;
+				return false;
+			}
+		}
+
+		if (settings.resolutions.empty())
+			settings.resolutions = { { 640, 480 }, { 1280, 720 }, { 1920, 1080 } };
+		if (settings.lightCounts.empty())
+			settings.lightCounts = { 0 };
+
+		return true;
+	}
+
+	void ApplyKey(Renderer* pRenderer, const CameraKey& key)
+	{
+		pRenderer->SetCamera(key.origin, key.pitch, key.yaw);
+		pRenderer->SetMeshYaw(key.meshYaw);
+	}
+}
+
+int main(int argc, char* args[])
+{
+	BenchmarkSettings settings{};
+	if (!ParseArguments(argc, args, settings))
+		return 1;
+
+	CameraPath path{ CameraPath::CreateDefault() };
+	if (!settings.pathFile.empty() && !path.LoadFromFile(settings.pathFile))
+	{
+		std::cout << "Camera path could not be loaded: " << settings.pathFile << std::endl;
+		return 1;
+	}
+
+	//Same order as Renderer::StageTimings
+	const char* stageNames[]{ "clear", "shadowMap", "occlusionCulling", "lightCulling", "vertexTransform", "projection", "binning", "rasterization", "postProcess", "resolve", "blit", "present", "total" };
+	const int nrStages{ static_cast<int>(std::size(stageNames)) };
+
+	std::ostringstream json{};
+	json << "{\n";
+	json << "  \"frames\": " << settings.nrFrames << ",\n";
+	json << "  \"warmupFrames\": " << settings.nrWarmupFrames << ",\n";
+	json << "  \"path\": " << ToJsonString(settings.pathFile.empty() ? "default" : settings.pathFile) << ",\n";
+	json << "  \"pathDuration\": " << path.GetDuration() << ",\n";
+	json << "  \"frameLatency\": " << settings.frameLatency << ",\n";
+	json << "  \"lazyClear\": " << (settings.useLazyClear ? "true" : "false") << ",\n";
+	json << "  \"depthFormat\": " << ToJsonString(depthFormatNames[static_cast<int>(settings.depthFormat)]) << ",\n";
+	json << "  \"depthCompression\": " << (settings.useDepthCompression ? "true" : "false") << ",\n";
+	json << "  \"instances\": " << ToJsonString(std::to_string(settings.nrInstanceColumns) + "x" + std::to_string(settings.nrInstanceRows)) << ",\n";
+	json << "  \"occlusionCulling\": " << (settings.useOcclusionCulling ? "true" : "false") << ",\n";
+	json << "  \"fastSpecular\": " << (settings.useFastSpecular ? "true" : "false") << ",\n";
+	json << "  \"lightCulling\": " << (settings.useLightCulling ? "true" : "false") << ",\n";
+	json << "  \"shadingRate\": " << ToJsonString(shadingRatePolicyNames[static_cast<int>(settings.shadingRatePolicy)]) << ",\n";
+	json << "  \"targetFrameTime\": " << settings.targetFrameTime << ",\n";
+	json << "  \"incrementalRendering\": " << (settings.useIncrementalRendering ? "true" : "false") << ",\n";
+	json << "  \"msaa\": " << (settings.useMsaa ? 4 : 1) << ",\n";
+	json << "  \"fxaa\": " << (settings.useFxaa ? "true" : "false") << ",\n";
+	json << "  \"results\": [\n";
+
+	const size_t nrRuns{ settings.resolutions.size() * settings.lightCounts.size() };
+	for (size_t runIndex{}; runIndex < nrRuns; ++runIndex)
+	{
+		const Resolution& resolution{ settings.resolutions[runIndex / settings.lightCounts.size()] };
+		const int nrLights{ settings.lightCounts[runIndex % settings.lightCounts.size()] };
+		const auto pRenderer = new Renderer(resolution.width, resolution.height);
+		if (!settings.useLazyClear)
+			pRenderer->ToggleLazyClear();
+		pRenderer->SetFrameLatency(settings.frameLatency);
+		pRenderer->SetDepthFormat(settings.depthFormat);
+		if (!settings.useDepthCompression)
+			pRenderer->ToggleDepthCompression();
+		pRenderer->SetInstanceGrid(settings.nrInstanceColumns, settings.nrInstanceRows);
+		if (!settings.useOcclusionCulling)
+			pRenderer->ToggleOcclusionCulling();
+		if (!settings.useFastSpecular)
+			pRenderer->ToggleFastSpecular();
+		pRenderer->ScatterLights(nrLights);
+		if (!settings.useLightCulling)
+			pRenderer->ToggleLightCulling();
+		pRenderer->SetShadingRatePolicy(settings.shadingRatePolicy);
+		if (settings.targetFrameTime > 0.0f)
+		{
+			pRenderer->ToggleDynamicResolution();
+			pRenderer->SetTargetFrameTime(settings.targetFrameTime);
+		}
+		if (!settings.useIncrementalRendering)
+			pRenderer->ToggleIncrementalRendering();
+		if (settings.useMsaa)
+			pRenderer->ToggleMsaa();
+		if (settings.useFxaa)
+			pRenderer->ToggleFxaa();
+
+		for (int frame{}; frame < settings.nrWarmupFrames; ++frame)
+		{
+			ApplyKey(pRenderer, path.Sample(0.f));
+			pRenderer->Render();
+			pRenderer->UpdateResolutionScale(pRenderer->GetStageTimings().total);
+		}
+
+		//Summed over the measured frames, reported as average per frame
+		Renderer::PipelineStatistics statisticsSum{};
+
+		std::vector<std::vector<float>> stageSamples(nrStages);
+		for (auto& samples : stageSamples)
+			samples.reserve(settings.nrFrames);
+		//Render size of every measured frame with dynamic resolution
+		std::vector<float> resolutionScales{};
+		resolutionScales.reserve(settings.nrFrames);
+
+		//Fixed time step, every run replays exactly the same frames
+		const float timeStep{ path.GetDuration() / settings.nrFrames };
+		for (int frame{}; frame < settings.nrFrames; ++frame)
+		{
+			ApplyKey(pRenderer, path.Sample(frame * timeStep));
+			resolutionScales.push_back(pRenderer->GetResolutionScale());
+			pRenderer->Render();
+
+			const Renderer::StageTimings& timings{ pRenderer->GetStageTimings() };
+			pRenderer->UpdateResolutionScale(timings.total);
+			const float stageTimes[]{ timings.clear, timings.shadowMap, timings.occlusionCulling, timings.lightCulling, timings.vertexTransform, timings.projection, timings.binning, timings.rasterization, timings.postProcess, timings.resolve, timings.blit, timings.present, timings.total };
+			for (int stage{}; stage < nrStages; ++stage)
+				stageSamples[stage].push_back(stageTimes[stage]);
+
+			const Renderer::PipelineStatistics& statistics{ pRenderer->GetPipelineStatistics() };
+			statisticsSum.instancesSubmitted += statistics.instancesSubmitted;
+			statisticsSum.instancesFrustumCulled += statistics.instancesFrustumCulled;
+			statisticsSum.instancesOccluded += statistics.instancesOccluded;
+			statisticsSum.occluderTriangles += statistics.occluderTriangles;
+			statisticsSum.shadowMapTriangles += statistics.shadowMapTriangles;
+			statisticsSum.lightsSubmitted += statistics.lightsSubmitted;
+			statisticsSum.lightsCulled += statistics.lightsCulled;
+			statisticsSum.lightTileEntries += statistics.lightTileEntries;
+			statisticsSum.lightEvaluations += statistics.lightEvaluations;
+			statisticsSum.inputVertices += statistics.inputVertices;
+			statisticsSum.trianglesSubmitted += statistics.trianglesSubmitted;
+			statisticsSum.trianglesCulled += statistics.trianglesCulled;
+			statisticsSum.trianglesClipped += statistics.trianglesClipped;
+			statisticsSum.boundingBoxPixelsTested += statistics.boundingBoxPixelsTested;
+			statisticsSum.pixelsCovered += statistics.pixelsCovered;
+			statisticsSum.depthTestsPassed += statistics.depthTestsPassed;
+			statisticsSum.depthTestsFailed += statistics.depthTestsFailed;
+			statisticsSum.shaderInvocations += statistics.shaderInvocations;
+			statisticsSum.helperPixels += statistics.helperPixels;
+			statisticsSum.halfRateTiles += statistics.halfRateTiles;
+			statisticsSum.quarterRateTiles += statistics.quarterRateTiles;
+			statisticsSum.tilesUnchanged += statistics.tilesUnchanged;
+			statisticsSum.hiZTrianglesRejected += statistics.hiZTrianglesRejected;
+			statisticsSum.hiZBlocksRejected += statistics.hiZBlocksRejected;
+			statisticsSum.hiZPixelTestsAvoided += statistics.hiZPixelTestsAvoided;
+			statisticsSum.depthBytes += statistics.depthBytes;
+			statisticsSum.overdraw += statistics.overdraw;
+		}
+
+		//Depth only throughput on the same frames, nothing of the regular pipeline runs
+		std::vector<float> depthOnlySamples{};
+		depthOnlySamples.reserve(settings.nrFrames);
+		uint64_t depthOnlyTriangles{};
+		const float millisecondsPerCount{ 1000.0f / static_cast<float>(SDL_GetPerformanceFrequency()) };
+
+		for (int frame{}; frame < settings.nrFrames; ++frame)
+		{
+			ApplyKey(pRenderer, path.Sample(frame * timeStep));
+
+			const uint64_t start{ SDL_GetPerformanceCounter() };
+			depthOnlyTriangles += pRenderer->RenderDepthOnly();
+			depthOnlySamples.push_back((SDL_GetPerformanceCounter() - start) * millisecondsPerCount);
+		}
+
+		delete pRenderer;
+
+		json << "    {\n";
+		json << "      \"width\": " << resolution.width << ",\n";
+		json << "      \"height\": " << resolution.height << ",\n";
+		json << "      \"lights\": " << nrLights << ",\n";
+		json << "      \"stages\": {\n";
+		for (int stage{}; stage < nrStages; ++stage)
+		{
+			const StageResult result{ Summarize(stageSamples[stage]) };
+			json << "        " << ToJsonString(stageNames[stage]) << ": { \"minMs\": " << result.min
+				<< ", \"medianMs\": " << result.median
+				<< ", \"p99Ms\": " << result.p99 << " }"
+				<< (stage + 1 < nrStages ? "," : "") << "\n";
+		}
+		json << "      },\n";
+
+		json << "      \"resolutionScales\": [";
+		for (size_t frame{}; frame < resolutionScales.size(); ++frame)
+			json << (frame > 0 ? ", " : "") << resolutionScales[frame];
+		json << "],\n";
+
+		const StageResult depthOnlyResult{ Summarize(depthOnlySamples) };
+		const double depthOnlyTrianglesPerFrame{ static_cast<double>(depthOnlyTriangles) / settings.nrFrames };
+		json << "      \"depthOnly\": { \"minMs\": " << depthOnlyResult.min
+			<< ", \"medianMs\": " << depthOnlyResult.median
+			<< ", \"p99Ms\": " << depthOnlyResult.p99
+			<< ", \"triangles\": " << depthOnlyTrianglesPerFrame
+			<< ", \"mTrianglesPerSecond\": " << (depthOnlyResult.median > 0.0f ? depthOnlyTrianglesPerFrame / depthOnlyResult.median / 1000.0 : 0.0) << " },\n";
+
+		const auto average = [&](double sum) { return sum / settings.nrFrames; };
+		json << "      \"statistics\": {\n";
+		json << "        \"instancesSubmitted\": " << average(static_cast<double>(statisticsSum.instancesSubmitted)) << ",\n";
+		json << "        \"instancesFrustumCulled\": " << average(static_cast<double>(statisticsSum.instancesFrustumCulled)) << ",\n";
+		json << "        \"instancesOccluded\": " << average(static_cast<double>(statisticsSum.instancesOccluded)) << ",\n";
+		json << "        \"occluderTriangles\": " << average(static_cast<double>(statisticsSum.occluderTriangles)) << ",\n";
+		json << "        \"shadowMapTriangles\": " << average(static_cast<double>(statisticsSum.shadowMapTriangles)) << ",\n";
+		json << "        \"lightsSubmitted\": " << average(static_cast<double>(statisticsSum.lightsSubmitted)) << ",\n";
+		json << "        \"lightsCulled\": " << average(static_cast<double>(statisticsSum.lightsCulled)) << ",\n";
+		json << "        \"lightTileEntries\": " << average(static_cast<double>(statisticsSum.lightTileEntries)) << ",\n";
+		json << "        \"lightEvaluations\": " << average(static_cast<double>(statisticsSum.lightEvaluations)) << ",\n";
+		json << "        \"inputVertices\": " << average(static_cast<double>(statisticsSum.inputVertices)) << ",\n";
+		json << "        \"trianglesSubmitted\": " << average(static_cast<double>(statisticsSum.trianglesSubmitted)) << ",\n";
+		json << "        \"trianglesCulled\": " << average(static_cast<double>(statisticsSum.trianglesCulled)) << ",\n";
+		json << "        \"trianglesClipped\": " << average(static_cast<double>(statisticsSum.trianglesClipped)) << ",\n";
+		json << "        \"boundingBoxPixelsTested\": " << average(static_cast<double>(statisticsSum.boundingBoxPixelsTested)) << ",\n";
+		json << "        \"pixelsCovered\": " << average(static_cast<double>(statisticsSum.pixelsCovered)) << ",\n";
+		json << "        \"depthTestsPassed\": " << average(static_cast<double>(statisticsSum.depthTestsPassed)) << ",\n";
+		json << "        \"depthTestsFailed\": " << average(static_cast<double>(statisticsSum.depthTestsFailed)) << ",\n";
+		json << "        \"shaderInvocations\": " << average(static_cast<double>(statisticsSum.shaderInvocations)) << ",\n";
+		json << "        \"helperPixels\": " << average(static_cast<double>(statisticsSum.helperPixels)) << ",\n";
+		json << "        \"halfRateTiles\": " << average(static_cast<double>(statisticsSum.halfRateTiles)) << ",\n";
+		json << "        \"quarterRateTiles\": " << average(static_cast<double>(statisticsSum.quarterRateTiles)) << ",\n";
+		json << "        \"tilesUnchanged\": " << average(static_cast<double>(statisticsSum.tilesUnchanged)) << ",\n";
+		json << "        \"hiZTrianglesRejected\": " << average(static_cast<double>(statisticsSum.hiZTrianglesRejected)) << ",\n";
+		json << "        \"hiZBlocksRejected\": " << average(static_cast<double>(statisticsSum.hiZBlocksRejected)) << ",\n";
+		json << "        \"hiZPixelTestsAvoided\": " << average(static_cast<double>(statisticsSum.hiZPixelTestsAvoided)) << ",\n";
+		json << "        \"depthBytes\": " << average(static_cast<double>(statisticsSum.depthBytes)) << ",\n";
+		json << "        \"overdraw\": " << average(statisticsSum.overdraw) << "\n";
+		json << "      }\n";
+		json << "    }" << (runIndex + 1 < nrRuns ? "," : "") << "\n";
+	}
+
+	json << "  ]\n";
+	json << "}\n";
+
+	std::cout << json.str();
+
+	if (!settings.traceFile.empty() && !PROFILE_SAVE(settings.traceFile))
+		std::cout << "Profile could not be written to " << settings.traceFile << std::endl;
+
+	std::ofstream outputFile{ settings.outputFile };
+	if (!outputFile || !(outputFile << json.str()))
+	{
+		std::cout << "Benchmark results could not be written to " << settings.outputFile << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -33,6 +33,8 @@ namespace dae
 
 		const float near{ 0.1f };
 		const float far{ 100 };
+		//Near depth is 1 and far depth 0, the depth test passes for larger values
+		bool isReversedZ{ true };
 
 		Vector3 forward{ Vector3::UnitZ };
 		Vector3 up{ Vector3::UnitY };
@@ -89,7 +91,10 @@ namespace dae
 			//TODO W2
 
 			//ProjectionMatrix => Matrix::CreatePerspectiveFovLH(...) [not implemented yet]
-			projectionMatrix = Matrix::CreatePerspectiveFovLH(fov, aspectRatio, near, far);
+			if (isReversedZ)
+				projectionMatrix = Matrix::CreatePerspectiveFovLHReversedZ(fov, aspectRatio, near, far);
+			else
+				projectionMatrix = Matrix::CreatePerspectiveFovLH(fov, aspectRatio, near, far);
 			//DirectX Implementation => https://learn.microsoft.com/en-us/windows/win32/direct3d9/d3dxmatrixperspectivefovlh
 		}
 
@@ -136,6 +141,24 @@ namespace dae
 			}
 
 
+			//Update Matrices
+			CalculateForward();
+			CalculateViewMatrix();
+		}
+
+		//Places the camera directly, without input, used to replay recorded camera paths
+		void SetTransform(const Vector3& _origin, float _totalPitch, float _totalYaw)
+		{
+			origin = _origin;
+			totalPitch = _totalPitch;
+			totalYaw = _totalYaw;
+
+			CalculateForward();
+			CalculateViewMatrix();
+		}
+
+		void CalculateForward()
+		{
 			Matrix pitchMatrix{ Matrix::CreateRotationX(totalPitch * TO_RADIANS) };
 			Matrix yawMatrix{ Matrix::CreateRotationY(totalYaw * TO_RADIANS) };
 			Matrix rollMatrix{ Matrix::CreateRotationZ(0) };
@@ -143,8 +166,6 @@ namespace dae
 			Matrix rotationMatrix{ pitchMatrix * yawMatrix * rollMatrix };
 
 			forward = rotationMatrix.TransformVector(Vector3::UnitZ);
-			//Update Matrices
-			CalculateViewMatrix();
 		}
 	};
 }
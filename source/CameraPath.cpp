@@ -0,0 +1,93 @@
+#include "CameraPath.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace dae
+{
+	CameraPath CameraPath::CreateDefault()
+	{
+		//Flies up to the vehicle, around it and back while the vehicle turns a full circle
+		CameraPath path{};
+		path.AddKey({ 0.f, { 0.f, 0.f, 0.f }, 0.f, 0.f, 0.f });
+		path.AddKey({ 2.f, { 0.f, 0.f, 25.f }, 0.f, 0.f, 90.f });
+		path.AddKey({ 4.f, { -10.f, 5.f, 20.f }, -9.f, 18.f, 180.f });
+		path.AddKey({ 6.f, { 10.f, -3.f, 15.f }, 5.f, -16.f, 270.f });
+		path.AddKey({ 8.f, { 0.f, 0.f, 0.f }, 0.f, 0.f, 360.f });
+		return path;
+	}
+
+	void CameraPath::AddKey(const CameraKey& key)
+	{
+		//Keep the keys sorted on time
+		auto it{ std::upper_bound(m_Keys.begin(), m_Keys.end(), key.time,
+			[](float time, const CameraKey& other) { return time < other.time; }) };
+		m_Keys.insert(it, key);
+	}
+
+	CameraKey CameraPath::Sample(float time) const
+	{
+		if (m_Keys.empty())
+			return {};
+
+		if (time <= m_Keys.front().time)
+			return m_Keys.front();
+		if (time >= m_Keys.back().time)
+			return m_Keys.back();
+
+		auto next{ std::upper_bound(m_Keys.begin(), m_Keys.end(), time,
+			[](float t, const CameraKey& key) { return t < key.time; }) };
+		const CameraKey& k1{ *next };
+		const CameraKey& k0{ *(next - 1) };
+
+		const float factor{ (time - k0.time) / (k1.time - k0.time) };
+
+		return CameraKey{
+			time,
+			k0.origin + (k1.origin - k0.origin) * factor,
+			Lerpf(k0.pitch, k1.pitch, factor),
+			Lerpf(k0.yaw, k1.yaw, factor),
+			Lerpf(k0.meshYaw, k1.meshYaw, factor)
+		};
+	}
+
+	bool CameraPath::LoadFromFile(const std::string& path)
+	{
+		std::ifstream file(path);
+		if (!file)
+			return false;
+
+		m_Keys.clear();
+
+		std::string line;
+		while (std::getline(file, line))
+		{
+			if (line.empty() || line[0] == '#')
+				continue;
+
+			std::istringstream lineStream{ line };
+			CameraKey key{};
+			if (lineStream >> key.time >> key.origin.x >> key.origin.y >> key.origin.z >> key.pitch >> key.yaw >> key.meshYaw)
+				AddKey(key);
+		}
+
+		return !m_Keys.empty();
+	}
+
+	bool CameraPath::SaveToFile(const std::string& path) const
+	{
+		std::ofstream file(path);
+		if (!file)
+			return false;
+
+		file << "# time originX originY originZ pitch yaw meshYaw\n";
+		for (const CameraKey& key : m_Keys)
+		{
+			file << key.time << ' '
+				<< key.origin.x << ' ' << key.origin.y << ' ' << key.origin.z << ' '
+				<< key.pitch << ' ' << key.yaw << ' ' << key.meshYaw << '\n';
+		}
+
+		return static_cast<bool>(file);
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "Math.h"
+
+namespace dae
+{
+	struct CameraKey
+	{
+		float time{};
+		Vector3 origin{};
+		float pitch{};
+		float yaw{};
+		float meshYaw{};
+	};
+
+	//Scripted camera + mesh rotation over time, replayed by the benchmark
+	class CameraPath final
+	{
+	public:
+		static CameraPath CreateDefault();
+
+		void AddKey(const CameraKey& key);
+		void Clear() { m_Keys.clear(); };
+
+		//Linear interpolation between the surrounding keys, clamped to the first/last key
+		CameraKey Sample(float time) const;
+
+		bool IsEmpty() const { return m_Keys.empty(); };
+		float GetDuration() const { return m_Keys.empty() ? 0.f : m_Keys.back().time; };
+
+		//One key per line: time originX originY originZ pitch yaw meshYaw, '#' starts a comment
+		bool LoadFromFile(const std::string& path);
+		bool SaveToFile(const std::string& path) const;
+
+	private:
+		std::vector<CameraKey> m_Keys{};
+	};
+}
@@ -22,6 +22,32 @@ namespace dae
 		Vector3 normal{};
 		Vector3 tangent{};
 		Vector3 viewDirection{};
+		//Shadow map texel coordinates and light depth
+		Vector3 shadowPosition{};
+		//Only filled when point or spot lights have to be shaded
+		Vector3 worldPosition{};
+	};
+
+	enum class LightType
+	{
+		Point,
+		Spot,
+	};
+
+	//Local light, shaded like the directional light but without shadows
+	struct Light
+	{
+		LightType type{ LightType::Point };
+		Vector3 position{};
+		//Spot lights only, the axis of the cone
+		Vector3 direction{ -Vector3::UnitY };
+		ColorRGB color{ colors::White };
+		float intensity{ 7.0f };
+		//Falls off smoothly to nothing at this distance
+		float radius{ 10.0f };
+		//Spot lights only, half angles in degrees, full intensity inside the inner cone and none outside the outer one
+		float innerConeAngle{ 20.0f };
+		float outerConeAngle{ 30.0f };
 	};
 
 	enum class PrimitiveTopology
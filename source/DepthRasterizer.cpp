@@ -0,0 +1,124 @@
+#include "DepthRasterizer.h"
+#include "FrameBuffer.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace dae
+{
+	DepthRasterizer::DepthRasterizer(int width, int height, int downscale, bool isConservative) :
+		m_ScreenWidth{ width },
+		m_ScreenHeight{ height },
+		m_Downscale{ downscale },
+		m_Width{ (width + downscale - 1) / downscale },
+		m_Height{ (height + downscale - 1) / downscale },
+		m_IsConservative{ isConservative }
+	{
+		m_DepthPixels.resize(static_cast<size_t>(m_Width) * m_Height);
+	}
+
+	void DepthRasterizer::Clear(bool isReversedZ)
+	{
+		m_IsReversedZ = isReversedZ;
+		std::fill(m_DepthPixels.begin(), m_DepthPixels.end(), isReversedZ ? 0.0f : FLT_MAX);
+	}
+
+	int DepthRasterizer::RasterizeTriangles(const Matrix& worldViewProjection, const std::vector<Vector3>& positions, const std::vector<uint32_t>& indices)
+	{
+		PROFILE_SCOPE("DepthOnly");
+
+		//Same screen mapping as the tile rasterizer
+		m_ScreenVertices.clear();
+		m_ScreenVertices.reserve(positions.size());
+		for (const Vector3& position : positions)
+		{
+			const Vector4 clipPosition{ worldViewProjection.TransformPoint({ position, 1.0f }) };
+			const float x{ clipPosition.x / clipPosition.w }, y{ clipPosition.y / clipPosition.w };
+
+			//Triangles with a vertex outside the screen are not drawn
+			const bool isDrawn{ clipPosition.w > 0.0f && x >= -1.0f && x <= 1.0f && y >= -1.0f && y <= 1.0f };
+			m_ScreenVertices.push_back({
+				(x + 1) * 0.5f * m_ScreenWidth,
+				(1.0f - y) * 0.5f * m_ScreenHeight,
+				clipPosition.z / clipPosition.w,
+				isDrawn ? clipPosition.w : -1.0f
+				});
+		}
+
+		//Regular buffers sample the top left screen pixel of every block, like the tile rasterizer, conservative ones the center
+		const float sampleOffset{ m_IsConservative ? (m_Downscale - 1) * 0.5f : 0.0f };
+		int nrTrianglesRasterized{};
+
+		for (size_t i{}; i + 2 < indices.size(); i += 3)
+		{
+			const Vector4& p0{ m_ScreenVertices[indices[i]] };
+			const Vector4& p1{ m_ScreenVertices[indices[i + 1]] };
+			const Vector4& p2{ m_ScreenVertices[indices[i + 2]] };
+
+			if (p0.w <= 0.0f || p1.w <= 0.0f || p2.w <= 0.0f)
+				continue;
+
+			//Part of a conservative block could fall outside the depth range, where the rasterizer draws nothing
+			if (m_IsConservative &&
+				(p0.z < 0.0f || p0.z > 1.0f || p1.z < 0.0f || p1.z > 1.0f || p2.z < 0.0f || p2.z > 1.0f))
+				continue;
+
+			const Vector2 v0{ p0.x, p0.y }, v1{ p1.x, p1.y }, v2{ p2.x, p2.y };
+			const Vector2 edge0{ v1 - v0 };
+			const Vector2 edge1{ v2 - v1 };
+			const Vector2 edge2{ v0 - v2 };
+
+			//Back facing or degenerate, no pixel passes all three edges
+			const float triangleArea{ Vector2::Cross(edge0, edge1) };
+			if (triangleArea <= 0.0f)
+				continue;
+
+			const Vector2 v0ToV2{ v2 - v0 };
+			const DepthPlane depthPlane{ v0.x, v0.y, p0.z,
+				((p1.z - p0.z) * v0ToV2.y - (p2.z - p0.z) * edge0.y) / triangleArea,
+				((p2.z - p0.z) * edge0.x - (p1.z - p0.z) * v0ToV2.x) / triangleArea };
+
+			//Farthest depth of the plane anywhere in the block around the sample
+			const float farthestOffset{ sampleOffset * (std::abs(depthPlane.gradientX) + std::abs(depthPlane.gradientY)) };
+
+			const Vector2 minBB{ Vector2::Min(v0, Vector2::Min(v1, v2)) };
+			const Vector2 maxBB{ Vector2::Max(v0, Vector2::Max(v1, v2)) };
+
+			const int startX{ std::max(static_cast<int>(std::ceil((minBB.x - sampleOffset) / m_Downscale)), 0) };
+			const int endX{ std::min(static_cast<int>(std::floor((maxBB.x - sampleOffset) / m_Downscale)), m_Width - 1) };
+			const int startY{ std::max(static_cast<int>(std::ceil((minBB.y - sampleOffset) / m_Downscale)), 0) };
+			const int endY{ std::min(static_cast<int>(std::floor((maxBB.y - sampleOffset) / m_Downscale)), m_Height - 1) };
+
+			if (startX > endX || startY > endY)
+				continue;
+
+			++nrTrianglesRasterized;
+
+			for (int y{ startY }; y <= endY; ++y)
+			{
+				float* pDepthRow{ m_DepthPixels.data() + static_cast<size_t>(y) * m_Width };
+				const float sampleY{ static_cast<float>(y * m_Downscale) + sampleOffset };
+
+				for (int x{ startX }; x <= endX; ++x)
+				{
+					const Vector2 sample{ static_cast<float>(x * m_Downscale) + sampleOffset, sampleY };
+
+					if (!(Vector2::Cross(edge0, sample - v0) > 0 && Vector2::Cross(edge1, sample - v1) > 0 && Vector2::Cross(edge2, sample - v2) > 0))
+						continue;
+
+					float depth{ depthPlane.At(sample.x, sample.y) };
+					if (m_IsConservative)
+						depth = m_IsReversedZ ? depth - farthestOffset : depth + farthestOffset;
+					else if (depth < 0.0f || depth > 1.0f)
+						continue;
+
+					if (IsCloser(depth, pDepthRow[x]))
+						pDepthRow[x] = depth;
+				}
+			}
+		}
+
+		return nrTrianglesRasterized;
+	}
+}
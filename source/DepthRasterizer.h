@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "Math.h"
+
+namespace dae
+{
+	//Rasterizes position only triangles into a float depth buffer, no attributes are set up and nothing is shaded
+	//Building block for depth pre-passes, shadow maps and the occlusion buffer
+	class DepthRasterizer final
+	{
+	public:
+		//Covers a width x height screen with one depth value per downscale x downscale block of screen pixels
+		//Conservative buffers store the farthest depth of a triangle over the whole block, so they can be used for occlusion tests
+		DepthRasterizer(int width, int height, int downscale = 1, bool isConservative = false);
+
+		void Clear(bool isReversedZ);
+
+		//Triangle list with the same culling, winding and coverage rules as the tile rasterizer
+		//Returns the number of triangles that reached the pixel loop
+		int RasterizeTriangles(const Matrix& worldViewProjection, const std::vector<Vector3>& positions, const std::vector<uint32_t>& indices);
+
+		int GetWidth() const { return m_Width; };
+		int GetHeight() const { return m_Height; };
+		int GetDownscale() const { return m_Downscale; };
+		bool IsReversedZ() const { return m_IsReversedZ; };
+		const float* GetDepthPixels() const { return m_DepthPixels.data(); };
+
+		bool IsCloser(float depth, float otherDepth) const { return m_IsReversedZ ? depth > otherDepth : depth < otherDepth; };
+
+	private:
+		int m_ScreenWidth{};
+		int m_ScreenHeight{};
+		int m_Downscale{};
+		int m_Width{};
+		int m_Height{};
+		bool m_IsConservative{};
+		bool m_IsReversedZ{ true };
+
+		std::vector<float> m_DepthPixels{};
+		//Screen position and depth, w <= 0 marks vertices of triangles the rasterizer does not draw
+		std::vector<Vector4> m_ScreenVertices{};
+	};
+}
@@ -0,0 +1,776 @@
+#include "FrameBuffer.h"
+#include <SDL_surface.h>
+#include <algorithm>
+#include <cassert>
+#include <emmintrin.h>
+
+namespace dae
+{
+	bool PackedPixelFormat::FromSDL(const SDL_PixelFormat* pFormat, PackedPixelFormat& packedFormat)
+	{
+		if (!pFormat || pFormat->BytesPerPixel != 4 || pFormat->palette)
+			return false;
+
+		//Every color channel has to be a full byte
+		if (pFormat->Rloss != 0 || pFormat->Gloss != 0 || pFormat->Bloss != 0)
+			return false;
+
+		packedFormat.redShift = pFormat->Rshift;
+		packedFormat.greenShift = pFormat->Gshift;
+		packedFormat.blueShift = pFormat->Bshift;
+		packedFormat.alphaMask = pFormat->Amask;
+		return true;
+	}
+
+	FrameBuffer::FrameBuffer(int width, int height) :
+		m_Width{ width },
+		m_Height{ height },
+		m_RenderWidth{ width },
+		m_RenderHeight{ height },
+		m_SampleWidth{ width },
+		m_SampleHeight{ height },
+		m_RedPixels(static_cast<size_t>(width) * height),
+		m_GreenPixels(static_cast<size_t>(width) * height),
+		m_BluePixels(static_cast<size_t>(width) * height),
+		m_ColorPixels(static_cast<size_t>(width) * height),
+		m_DepthPixels(static_cast<size_t>(width) * height),
+		m_CoarseWidth{ (width + CoarseBlockSize - 1) / CoarseBlockSize },
+		m_CoarseHeight{ (height + CoarseBlockSize - 1) / CoarseBlockSize },
+		m_CoarseDepthPixels(static_cast<size_t>(m_CoarseWidth) * m_CoarseHeight),
+		m_DepthBlockStates(static_cast<size_t>(m_CoarseWidth) * m_CoarseHeight, DepthBlockState::Pixels),
+		m_DepthBlockPlanes(static_cast<size_t>(m_CoarseWidth) * m_CoarseHeight)
+	{
+		//Wrapping existing memory in a surface does not need SDL_Init, so this also works without a display
+		m_pSurface = SDL_CreateRGBSurfaceFrom(m_ColorPixels.data(), m_Width, m_Height, 32, m_Width * static_cast<int>(sizeof(uint32_t)),
+			0x00FF0000, 0x0000FF00, 0x000000FF, 0);
+
+		assert(m_pSurface && "FrameBuffer surface failed to create.");
+
+		const bool isPacked{ PackedPixelFormat::FromSDL(m_pSurface->format, m_SurfaceFormat) };
+		assert(isPacked && "FrameBuffer surface is not a packed 32 bit format.");
+		(void)isPacked;
+
+		InitResolve();
+	}
+
+	FrameBuffer::~FrameBuffer()
+	{
+		if (m_pSurface)
+		{
+			SDL_FreeSurface(m_pSurface);
+			m_pSurface = nullptr;
+		}
+	}
+
+	void FrameBuffer::Clear(const ColorRGB& color, float depth, bool isNonTemporal)
+	{
+		SetDepthClearValue(depth);
+		ClearRegion(0, 0, m_SampleWidth, m_SampleHeight, color, depth, isNonTemporal);
+	}
+
+	void FrameBuffer::SetRenderSize(int width, int height)
+	{
+		width = std::clamp(width, 1, m_Width);
+		height = std::clamp(height, 1, m_Height);
+		if (width == m_RenderWidth && height == m_RenderHeight)
+			return;
+
+		m_RenderWidth = width;
+		m_RenderHeight = height;
+		InitResolve();
+	}
+
+	void FrameBuffer::InitResolve()
+	{
+		//Pixel centers sit on integer coordinates on both sizes, like the NDC => screen mapping of the renderer
+		const bool isUpscaled{ m_RenderWidth != m_Width || m_RenderHeight != m_Height };
+		const float scaleX{ static_cast<float>(m_RenderWidth) / m_Width };
+		const size_t nrColumns{ isUpscaled ? static_cast<size_t>(m_Width) : 0 };
+		m_ResolveLeftColumns.resize(nrColumns);
+		m_ResolveRightColumns.resize(nrColumns);
+		m_ResolveRightWeights.resize(nrColumns);
+		for (size_t px{}; px < nrColumns; ++px)
+		{
+			const float sourceX{ px * scaleX };
+			m_ResolveLeftColumns[px] = std::min(static_cast<int>(sourceX), m_RenderWidth - 1);
+			m_ResolveRightColumns[px] = std::min(m_ResolveLeftColumns[px] + 1, m_RenderWidth - 1);
+			m_ResolveRightWeights[px] = sourceX - m_ResolveLeftColumns[px];
+		}
+
+		m_ResolveBlendedRow.resize(isUpscaled ? static_cast<size_t>(m_RenderWidth) * 3 : 0);
+		m_ResolveScaledRow.resize(nrColumns * 3);
+		m_ResolvedSampleRows.resize(m_SamplesPerSide > 1 ? static_cast<size_t>(m_RenderWidth) * 3 * 2 : 0);
+	}
+
+	void FrameBuffer::SetSampleCount(int nrSamples)
+	{
+		const int samplesPerSide{ nrSamples >= 4 ? 2 : 1 };
+		if (samplesPerSide == m_SamplesPerSide)
+			return;
+
+		m_SamplesPerSide = samplesPerSide;
+		m_SampleWidth = m_Width * samplesPerSide;
+		m_SampleHeight = m_Height * samplesPerSide;
+		m_CoarseWidth = (m_SampleWidth + CoarseBlockSize - 1) / CoarseBlockSize;
+		m_CoarseHeight = (m_SampleHeight + CoarseBlockSize - 1) / CoarseBlockSize;
+
+		//Swapped instead of resized, so going back to a single sample frees the memory
+		const size_t nrGridSamples{ static_cast<size_t>(m_SampleWidth) * m_SampleHeight };
+		std::vector<float>(nrGridSamples).swap(m_RedPixels);
+		std::vector<float>(nrGridSamples).swap(m_GreenPixels);
+		std::vector<float>(nrGridSamples).swap(m_BluePixels);
+		if (m_DepthFormat == DepthFormat::Unorm16)
+			std::vector<uint16_t>(nrGridSamples).swap(m_Depth16Pixels);
+		else
+			std::vector<uint32_t>(nrGridSamples).swap(m_DepthPixels);
+
+		const size_t nrBlocks{ static_cast<size_t>(m_CoarseWidth) * m_CoarseHeight };
+		std::vector<float>(nrBlocks).swap(m_CoarseDepthPixels);
+		std::vector<DepthBlockState>(nrBlocks, DepthBlockState::Pixels).swap(m_DepthBlockStates);
+		std::vector<DepthPlane>(nrBlocks).swap(m_DepthBlockPlanes);
+
+		InitResolve();
+	}
+
+	void FrameBuffer::SetDepthFormat(DepthFormat format)
+	{
+		if (format == m_DepthFormat)
+			return;
+
+		m_DepthFormat = format;
+
+		const size_t nrPixels{ static_cast<size_t>(m_SampleWidth) * m_SampleHeight };
+		if (m_DepthFormat == DepthFormat::Unorm16)
+		{
+			m_Depth16Pixels.resize(nrPixels);
+			std::vector<uint32_t>{}.swap(m_DepthPixels);
+		}
+		else
+		{
+			m_DepthPixels.resize(nrPixels);
+			std::vector<uint16_t>{}.swap(m_Depth16Pixels);
+		}
+	}
+
+	void FrameBuffer::SetFxaa(bool isEnabled)
+	{
+		if (isEnabled == IsUsingFxaa())
+			return;
+
+		//Swapped instead of resized, so disabling it frees the memory
+		const size_t nrPixels{ isEnabled ? static_cast<size_t>(m_Width) * m_Height : 0 };
+		std::vector<float>(nrPixels).swap(m_FxaaLumaPixels);
+		std::vector<float>(nrPixels).swap(m_FxaaRedPixels);
+		std::vector<float>(nrPixels).swap(m_FxaaGreenPixels);
+		std::vector<float>(nrPixels).swap(m_FxaaBluePixels);
+	}
+
+	void FrameBuffer::ClearRegion(int x0, int y0, int x1, int y1, const ColorRGB& color, float depth, bool isNonTemporal)
+	{
+		assert(QuantizeDepth(depth) == m_DepthClearValue && "Depth clear value has to be set before clearing regions.");
+		(void)depth;
+
+		//Compressed blocks only need their state reset, 16 bit depth is cleared separately
+		const bool isDepthCleared{ !m_IsDepthCompressed };
+		const bool isDepthInRowPass{ isDepthCleared && m_DepthFormat != DepthFormat::Unorm16 };
+		const uint32_t depthValue{ m_DepthFormat == DepthFormat::Unorm16 ? 0 : EncodeDepth32(m_DepthClearValue) };
+		const uint16_t depth16Value{ static_cast<uint16_t>(EncodeUnorm(m_DepthClearValue, m_MaxUnorm16)) };
+
+		const __m128 red{ _mm_set1_ps(color.r) };
+		const __m128 green{ _mm_set1_ps(color.g) };
+		const __m128 blue{ _mm_set1_ps(color.b) };
+		const __m128 depth4{ _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(depthValue))) };
+
+		for (int py{ y0 }; py < y1; ++py)
+		{
+			const int rowStart{ py * m_SampleWidth };
+			float* pRed{ m_RedPixels.data() + rowStart };
+			float* pGreen{ m_GreenPixels.data() + rowStart };
+			float* pBlue{ m_BluePixels.data() + rowStart };
+			float* pDepth{ isDepthInRowPass ? reinterpret_cast<float*>(m_DepthPixels.data() + rowStart) : nullptr };
+
+			const auto isAligned = [&](int x)
+			{
+				return ((reinterpret_cast<uintptr_t>(pRed + x) | reinterpret_cast<uintptr_t>(pGreen + x) |
+					reinterpret_cast<uintptr_t>(pBlue + x) | (pDepth ? reinterpret_cast<uintptr_t>(pDepth + x) : 0)) & 15) == 0;
+			};
+
+			//Scalar until the row is 16 byte aligned in every plane
+			int px{ x0 };
+			for (; px < x1 && !isAligned(px); ++px)
+			{
+				pRed[px] = color.r;
+				pGreen[px] = color.g;
+				pBlue[px] = color.b;
+				if (pDepth)
+					m_DepthPixels[rowStart + px] = depthValue;
+			}
+
+			if (isNonTemporal)
+			{
+				for (; px + 4 <= x1; px += 4)
+				{
+					_mm_stream_ps(pRed + px, red);
+					_mm_stream_ps(pGreen + px, green);
+					_mm_stream_ps(pBlue + px, blue);
+					if (pDepth)
+						_mm_stream_ps(pDepth + px, depth4);
+				}
+			}
+			else
+			{
+				for (; px + 4 <= x1; px += 4)
+				{
+					_mm_store_ps(pRed + px, red);
+					_mm_store_ps(pGreen + px, green);
+					_mm_store_ps(pBlue + px, blue);
+					if (pDepth)
+						_mm_store_ps(pDepth + px, depth4);
+				}
+			}
+
+			for (; px < x1; ++px)
+			{
+				pRed[px] = color.r;
+				pGreen[px] = color.g;
+				pBlue[px] = color.b;
+				if (pDepth)
+					m_DepthPixels[rowStart + px] = depthValue;
+			}
+
+			if (isDepthCleared && m_DepthFormat == DepthFormat::Unorm16)
+				std::fill(m_Depth16Pixels.begin() + rowStart + x0, m_Depth16Pixels.begin() + rowStart + x1, depth16Value);
+		}
+
+		//Partially cleared blocks get the clear value too, the farthest depth stays conservative
+		if (x0 < x1 && y0 < y1)
+		{
+			const DepthBlockState blockState{ m_IsDepthCompressed ? DepthBlockState::Cleared : DepthBlockState::Pixels };
+			for (int blockY{ y0 / CoarseBlockSize }; blockY <= (y1 - 1) / CoarseBlockSize; ++blockY)
+			{
+				const int firstBlock{ blockY * m_CoarseWidth + x0 / CoarseBlockSize };
+				const int lastBlock{ blockY * m_CoarseWidth + (x1 - 1) / CoarseBlockSize };
+				std::fill(m_CoarseDepthPixels.begin() + firstBlock, m_CoarseDepthPixels.begin() + lastBlock + 1, m_DepthClearValue);
+				std::fill(m_DepthBlockStates.begin() + firstBlock, m_DepthBlockStates.begin() + lastBlock + 1, blockState);
+			}
+		}
+
+		//Streaming stores are weakly ordered, make them visible before anything reads the buffer
+		if (isNonTemporal)
+			_mm_sfence();
+	}
+
+	int FrameBuffer::LoadDepthBlock(int blockX, int blockY, float* pBlockDepth) const
+	{
+		const int blockIndex{ blockX + blockY * m_CoarseWidth };
+		const int startX{ blockX * CoarseBlockSize }, endX{ std::min(startX + CoarseBlockSize, m_SampleWidth) };
+		const int startY{ blockY * CoarseBlockSize }, endY{ std::min(startY + CoarseBlockSize, m_SampleHeight) };
+
+		switch (m_DepthBlockStates[blockIndex])
+		{
+		case DepthBlockState::Cleared:
+			std::fill_n(pBlockDepth, NrBlockPixels, m_DepthClearValue);
+			return 0;
+		case DepthBlockState::Plane:
+		{
+			const DepthPlane& plane{ m_DepthBlockPlanes[blockIndex] };
+			for (int y{}; y < CoarseBlockSize; ++y)
+			{
+				for (int x{}; x < CoarseBlockSize; ++x)
+					pBlockDepth[x + y * CoarseBlockSize] = QuantizeDepth(plane.At(static_cast<float>(startX + x), static_cast<float>(startY + y)));
+			}
+			return 0;
+		}
+		default:
+			break;
+		}
+
+		if (endX - startX < CoarseBlockSize || endY - startY < CoarseBlockSize)
+			std::fill_n(pBlockDepth, NrBlockPixels, m_DepthClearValue);
+
+		for (int py{ startY }; py < endY; ++py)
+		{
+			float* pRow{ pBlockDepth + (py - startY) * CoarseBlockSize - startX };
+			if (m_DepthFormat == DepthFormat::Unorm16)
+			{
+				for (int px{ startX }; px < endX; ++px)
+					pRow[px] = m_Depth16Pixels[px + py * m_SampleWidth] * (1.0f / m_MaxUnorm16);
+			}
+			else
+			{
+				for (int px{ startX }; px < endX; ++px)
+					pRow[px] = DecodeDepth32(m_DepthPixels[px + py * m_SampleWidth]);
+			}
+		}
+
+		return (endX - startX) * (endY - startY) * GetDepthBytesPerPixel();
+	}
+
+	int FrameBuffer::StoreDepthBlock(int blockX, int blockY, const float* pBlockDepth)
+	{
+		const int startX{ blockX * CoarseBlockSize }, endX{ std::min(startX + CoarseBlockSize, m_SampleWidth) };
+		const int startY{ blockY * CoarseBlockSize }, endY{ std::min(startY + CoarseBlockSize, m_SampleHeight) };
+
+		for (int py{ startY }; py < endY; ++py)
+		{
+			const float* pRow{ pBlockDepth + (py - startY) * CoarseBlockSize - startX };
+			if (m_DepthFormat == DepthFormat::Unorm16)
+			{
+				for (int px{ startX }; px < endX; ++px)
+					m_Depth16Pixels[px + py * m_SampleWidth] = static_cast<uint16_t>(EncodeUnorm(pRow[px], m_MaxUnorm16));
+			}
+			else
+			{
+				for (int px{ startX }; px < endX; ++px)
+					m_DepthPixels[px + py * m_SampleWidth] = EncodeDepth32(pRow[px]);
+			}
+		}
+
+		m_DepthBlockStates[blockX + blockY * m_CoarseWidth] = DepthBlockState::Pixels;
+		return (endX - startX) * (endY - startY) * GetDepthBytesPerPixel();
+	}
+
+	void FrameBuffer::StoreDepthBlockPlane(int blockX, int blockY, const DepthPlane& plane)
+	{
+		const int blockIndex{ blockX + blockY * m_CoarseWidth };
+		m_DepthBlockStates[blockIndex] = DepthBlockState::Plane;
+		m_DepthBlockPlanes[blockIndex] = plane;
+	}
+
+	void FrameBuffer::UpdateCoarseDepth(int blockX, int blockY, const float* pBlockDepth, bool isReversedZ)
+	{
+		//Smallest depth is the farthest one with reversed-Z, pixels outside the buffer hold the clear value which keeps this conservative
+		float farthestDepth{ pBlockDepth[0] };
+		for (int i{ 1 }; i < NrBlockPixels; ++i)
+			farthestDepth = isReversedZ ? std::min(farthestDepth, pBlockDepth[i]) : std::max(farthestDepth, pBlockDepth[i]);
+
+		m_CoarseDepthPixels[blockX + blockY * m_CoarseWidth] = farthestDepth;
+	}
+
+	void FrameBuffer::Resolve()
+	{
+		Resolve(m_ColorPixels.data(), m_Width * static_cast<int>(sizeof(uint32_t)), m_SurfaceFormat);
+	}
+
+	void FrameBuffer::Resolve(uint32_t* pDestination, int destinationPitch, const PackedPixelFormat& format)
+	{
+		const __m128 zero{ _mm_setzero_ps() };
+		const __m128 one{ _mm_set1_ps(1.f) };
+		const __m128 maxChannel{ _mm_set1_ps(255.f) };
+		const __m128i redShift{ _mm_cvtsi32_si128(static_cast<int>(format.redShift)) };
+		const __m128i greenShift{ _mm_cvtsi32_si128(static_cast<int>(format.greenShift)) };
+		const __m128i blueShift{ _mm_cvtsi32_si128(static_cast<int>(format.blueShift)) };
+		const __m128i alpha{ _mm_set1_epi32(static_cast<int>(format.alphaMask)) };
+
+		//The horizontal taps are in the scratch, the rows are blended vertically into a scratch row first
+		const bool isUpscaled{ m_RenderWidth != m_Width || m_RenderHeight != m_Height };
+		const float scaleY{ static_cast<float>(m_RenderHeight) / m_Height };
+
+		//Rows of the render size, multisampled pixels are averaged into one of two scratch rows first
+		//Upscaling reads every row for several destination rows, so the last two are kept and each is averaged once
+		const bool isFxaa{ IsUsingFxaa() };
+		const bool isMultisampled{ m_SamplesPerSide > 1 };
+		int resolvedRows[2]{ -1, -1 };
+		int lastSlot{};
+		const auto getSourceRow = [&](int row, const float* (&pChannels)[3])
+		{
+			if (isFxaa)
+			{
+				pChannels[0] = m_FxaaRedPixels.data() + row * m_Width;
+				pChannels[1] = m_FxaaGreenPixels.data() + row * m_Width;
+				pChannels[2] = m_FxaaBluePixels.data() + row * m_Width;
+				return;
+			}
+
+			if (!isMultisampled)
+			{
+				pChannels[0] = m_RedPixels.data() + row * m_SampleWidth;
+				pChannels[1] = m_GreenPixels.data() + row * m_SampleWidth;
+				pChannels[2] = m_BluePixels.data() + row * m_SampleWidth;
+				return;
+			}
+
+			//The other slot is the one not used last, a pair of rows never evicts its first row
+			int slot{ row == resolvedRows[0] ? 0 : row == resolvedRows[1] ? 1 : -1 };
+			float* pResolved{ m_ResolvedSampleRows.data() + (slot < 0 ? 1 - lastSlot : slot) * m_RenderWidth * 3 };
+			if (slot < 0)
+			{
+				slot = 1 - lastSlot;
+				resolvedRows[slot] = row;
+				ResolveSampleRow(row, pResolved, pResolved + m_RenderWidth, pResolved + 2 * m_RenderWidth);
+			}
+			lastSlot = slot;
+
+			for (int channel{}; channel < 3; ++channel)
+				pChannels[channel] = pResolved + channel * m_RenderWidth;
+		};
+
+		for (int py{}; py < m_Height; ++py)
+		{
+			const float* pRed{};
+			const float* pGreen{};
+			const float* pBlue{};
+
+			if (isUpscaled)
+			{
+				const float sourceY{ py * scaleY };
+				const int topRow{ std::min(static_cast<int>(sourceY), m_RenderHeight - 1) };
+				const int bottomRow{ std::min(topRow + 1, m_RenderHeight - 1) };
+				const __m128 bottomWeight{ _mm_set1_ps(sourceY - topRow) };
+
+				const float* pTopChannels[3]{};
+				const float* pBottomChannels[3]{};
+				getSourceRow(topRow, pTopChannels);
+				getSourceRow(bottomRow, pBottomChannels);
+				for (int channel{}; channel < 3; ++channel)
+				{
+					const float* pTop{ pTopChannels[channel] };
+					const float* pBottom{ pBottomChannels[channel] };
+					float* pBlended{ m_ResolveBlendedRow.data() + channel * m_RenderWidth };
+					float* pScaled{ m_ResolveScaledRow.data() + channel * m_Width };
+
+					int px{};
+					for (; px + 4 <= m_RenderWidth; px += 4)
+					{
+						const __m128 top{ _mm_loadu_ps(pTop + px) };
+						_mm_storeu_ps(pBlended + px, _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(pBottom + px), top), bottomWeight)));
+					}
+					for (; px < m_RenderWidth; ++px)
+						pBlended[px] = pTop[px] + (pBottom[px] - pTop[px]) * (sourceY - topRow);
+
+					for (px = 0; px < m_Width; ++px)
+					{
+						const float left{ pBlended[m_ResolveLeftColumns[px]] };
+						pScaled[px] = left + (pBlended[m_ResolveRightColumns[px]] - left) * m_ResolveRightWeights[px];
+					}
+				}
+
+				pRed = m_ResolveScaledRow.data();
+				pGreen = m_ResolveScaledRow.data() + m_Width;
+				pBlue = m_ResolveScaledRow.data() + 2 * m_Width;
+			}
+			else
+			{
+				const float* pChannels[3]{};
+				getSourceRow(py, pChannels);
+				pRed = pChannels[0];
+				pGreen = pChannels[1];
+				pBlue = pChannels[2];
+			}
+
+			uint32_t* pRow{ reinterpret_cast<uint32_t*>(reinterpret_cast<uint8_t*>(pDestination) + static_cast<ptrdiff_t>(py) * destinationPitch) };
+
+			//4 pixels at a time
+			int px{};
+			for (; px + 4 <= m_Width; px += 4)
+			{
+				__m128 red{ _mm_loadu_ps(pRed + px) };
+				__m128 green{ _mm_loadu_ps(pGreen + px) };
+				__m128 blue{ _mm_loadu_ps(pBlue + px) };
+
+				//Same as MaxToOne: divide by the largest channel when it is above one
+				const __m128 scale{ _mm_max_ps(_mm_max_ps(red, _mm_max_ps(green, blue)), one) };
+				red = _mm_max_ps(_mm_div_ps(red, scale), zero);
+				green = _mm_max_ps(_mm_div_ps(green, scale), zero);
+				blue = _mm_max_ps(_mm_div_ps(blue, scale), zero);
+
+				//Truncate like the static_cast<uint8_t> of the scalar path
+				const __m128i red8{ _mm_cvttps_epi32(_mm_mul_ps(red, maxChannel)) };
+				const __m128i green8{ _mm_cvttps_epi32(_mm_mul_ps(green, maxChannel)) };
+				const __m128i blue8{ _mm_cvttps_epi32(_mm_mul_ps(blue, maxChannel)) };
+
+				const __m128i packed{ _mm_or_si128(
+					_mm_or_si128(_mm_sll_epi32(red8, redShift), _mm_sll_epi32(green8, greenShift)),
+					_mm_or_si128(_mm_sll_epi32(blue8, blueShift), alpha)) };
+
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pRow + px), packed);
+			}
+
+			for (; px < m_Width; ++px)
+			{
+				ColorRGB color{ pRed[px], pGreen[px], pBlue[px] };
+				color.MaxToOne();
+
+				pRow[px] = static_cast<uint32_t>(static_cast<uint8_t>(std::max(color.r, 0.f) * 255)) << format.redShift |
+					static_cast<uint32_t>(static_cast<uint8_t>(std::max(color.g, 0.f) * 255)) << format.greenShift |
+					static_cast<uint32_t>(static_cast<uint8_t>(std::max(color.b, 0.f) * 255)) << format.blueShift |
+					format.alphaMask;
+			}
+		}
+	}
+
+	void FrameBuffer::ResolveSampleRow(int row, float* pRed, float* pGreen, float* pBlue) const
+	{
+		const __m128 one{ _mm_set1_ps(1.f) };
+		const __m128 quarter{ _mm_set1_ps(0.25f) };
+		const float* pPlanes[]{ m_RedPixels.data(), m_GreenPixels.data(), m_BluePixels.data() };
+
+		//The 2x2 samples of a pixel are two neighbours in two rows of the grid
+		const int topStart{ 2 * row * m_SampleWidth };
+		const int bottomStart{ topStart + m_SampleWidth };
+
+		//4 pixels, so 8 samples of both rows at a time
+		int px{};
+		for (; px + 4 <= m_RenderWidth; px += 4)
+		{
+			__m128 sums[3]{ _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+			for (int rowStart : { topStart, bottomStart })
+			{
+				//Left and right samples of the 4 pixels
+				__m128 left[3], right[3];
+				for (int channel{}; channel < 3; ++channel)
+				{
+					const __m128 first{ _mm_loadu_ps(pPlanes[channel] + rowStart + 2 * px) };
+					const __m128 second{ _mm_loadu_ps(pPlanes[channel] + rowStart + 2 * px + 4) };
+					left[channel] = _mm_shuffle_ps(first, second, _MM_SHUFFLE(2, 0, 2, 0));
+					right[channel] = _mm_shuffle_ps(first, second, _MM_SHUFFLE(3, 1, 3, 1));
+				}
+
+				//Like MaxToOne per sample, so a bright highlight does not outweigh the other samples of an edge pixel
+				for (__m128* pSamples : { left, right })
+				{
+					const __m128 inverseScale{ _mm_div_ps(one, _mm_max_ps(_mm_max_ps(pSamples[0], _mm_max_ps(pSamples[1], pSamples[2])), one)) };
+					for (int channel{}; channel < 3; ++channel)
+						sums[channel] = _mm_add_ps(sums[channel], _mm_mul_ps(pSamples[channel], inverseScale));
+				}
+			}
+
+			_mm_storeu_ps(pRed + px, _mm_mul_ps(sums[0], quarter));
+			_mm_storeu_ps(pGreen + px, _mm_mul_ps(sums[1], quarter));
+			_mm_storeu_ps(pBlue + px, _mm_mul_ps(sums[2], quarter));
+		}
+
+		for (; px < m_RenderWidth; ++px)
+		{
+			ColorRGB sum{};
+			for (int sample : { topStart + 2 * px, topStart + 2 * px + 1, bottomStart + 2 * px, bottomStart + 2 * px + 1 })
+			{
+				ColorRGB color{ m_RedPixels[sample], m_GreenPixels[sample], m_BluePixels[sample] };
+				color.MaxToOne();
+				sum += color;
+			}
+
+			pRed[px] = sum.r * 0.25f;
+			pGreen[px] = sum.g * 0.25f;
+			pBlue[px] = sum.b * 0.25f;
+		}
+	}
+
+	void FrameBuffer::CalculateFxaaLuma(int x0, int y0, int x1, int y1)
+	{
+		assert(m_SamplesPerSide == 1 && "FXAA only filters single sampled buffers.");
+
+		const __m128 one{ _mm_set1_ps(1.f) };
+		const __m128 redWeight{ _mm_set1_ps(0.299f) };
+		const __m128 greenWeight{ _mm_set1_ps(0.587f) };
+		const __m128 blueWeight{ _mm_set1_ps(0.114f) };
+
+		for (int py{ y0 }; py < y1; ++py)
+		{
+			const int rowStart{ py * m_Width };
+
+			//4 pixels at a time, of the colors as MaxToOne brings them in range
+			int px{ x0 };
+			for (; px + 4 <= x1; px += 4)
+			{
+				const __m128 red{ _mm_loadu_ps(m_RedPixels.data() + rowStart + px) };
+				const __m128 green{ _mm_loadu_ps(m_GreenPixels.data() + rowStart + px) };
+				const __m128 blue{ _mm_loadu_ps(m_BluePixels.data() + rowStart + px) };
+				const __m128 inverseScale{ _mm_div_ps(one, _mm_max_ps(_mm_max_ps(red, _mm_max_ps(green, blue)), one)) };
+				const __m128 luma{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(red, redWeight), _mm_mul_ps(green, greenWeight)), _mm_mul_ps(blue, blueWeight)) };
+				_mm_storeu_ps(m_FxaaLumaPixels.data() + rowStart + px, _mm_mul_ps(luma, inverseScale));
+			}
+
+			for (; px < x1; ++px)
+			{
+				ColorRGB color{ ReadColor(rowStart + px) };
+				color.MaxToOne();
+				m_FxaaLumaPixels[rowStart + px] = 0.299f * color.r + 0.587f * color.g + 0.114f * color.b;
+			}
+		}
+	}
+
+	void FrameBuffer::ApplyFxaa(int x0, int y0, int x1, int y1)
+	{
+		assert(m_SamplesPerSide == 1 && "FXAA only filters single sampled buffers.");
+
+		//Defaults of FXAA 3.11: less local contrast than either threshold is no edge, subpixel aliasing is blended up to 75%
+		constexpr float edgeThreshold{ 0.166f };
+		constexpr float edgeThresholdMin{ 0.0833f };
+		constexpr float subpixelQuality{ 0.75f };
+		//Pixels per step of the search for the ends of an edge
+		constexpr int searchSteps[]{ 1, 1, 1, 2, 2, 4, 8 };
+
+		const __m128 zero{ _mm_setzero_ps() };
+		const __m128 one{ _mm_set1_ps(1.f) };
+		const __m128 two{ _mm_set1_ps(2.f) };
+		const __m128 signBit{ _mm_set1_ps(-0.0f) };
+		const auto absolute = [&](__m128 value) { return _mm_andnot_ps(signBit, value); };
+		const auto select = [](__m128 mask, __m128 ifTrue, __m128 ifFalse) { return _mm_or_ps(_mm_and_ps(mask, ifTrue), _mm_andnot_ps(mask, ifFalse)); };
+
+		//Neighbours outside the render size repeat its border pixels
+		const int width{ m_RenderWidth };
+		const int height{ m_RenderHeight };
+		const float* pLuma{ m_FxaaLumaPixels.data() };
+
+		for (int py{ y0 }; py < y1; ++py)
+		{
+			const int rowStart{ py * m_Width };
+			const float* pRowUp{ pLuma + std::max(py - 1, 0) * m_Width };
+			const float* pRow{ pLuma + rowStart };
+			const float* pRowDown{ pLuma + std::min(py + 1, height - 1) * m_Width };
+
+			for (int px{ x0 }; px < x1; px += 4)
+			{
+				const int nrLanes{ std::min(x1 - px, 4) };
+				const bool isInterior{ px > 0 && px + 4 < width };
+				const auto load = [&](const float* pValues, int offset)
+				{
+					if (isInterior)
+						return _mm_loadu_ps(pValues + px + offset);
+
+					alignas(16) float values[4];
+					for (int lane{}; lane < 4; ++lane)
+						values[lane] = pValues[std::clamp(px + lane + offset, 0, width - 1)];
+					return _mm_load_ps(values);
+				};
+
+				//Unfiltered pixels only get brought in range
+				const __m128 red{ load(m_RedPixels.data() + rowStart, 0) };
+				const __m128 green{ load(m_GreenPixels.data() + rowStart, 0) };
+				const __m128 blue{ load(m_BluePixels.data() + rowStart, 0) };
+				const __m128 inverseScale{ _mm_div_ps(one, _mm_max_ps(_mm_max_ps(red, _mm_max_ps(green, blue)), one)) };
+				alignas(16) float filtered[3][4];
+				_mm_store_ps(filtered[0], _mm_mul_ps(red, inverseScale));
+				_mm_store_ps(filtered[1], _mm_mul_ps(green, inverseScale));
+				_mm_store_ps(filtered[2], _mm_mul_ps(blue, inverseScale));
+
+				const __m128 lumaM{ load(pRow, 0) };
+				const __m128 lumaN{ load(pRowUp, 0) };
+				const __m128 lumaS{ load(pRowDown, 0) };
+				const __m128 lumaW{ load(pRow, -1) };
+				const __m128 lumaE{ load(pRow, 1) };
+
+				const __m128 lumaMax{ _mm_max_ps(_mm_max_ps(lumaM, _mm_max_ps(lumaN, lumaS)), _mm_max_ps(lumaW, lumaE)) };
+				const __m128 lumaMin{ _mm_min_ps(_mm_min_ps(lumaM, _mm_min_ps(lumaN, lumaS)), _mm_min_ps(lumaW, lumaE)) };
+				const __m128 lumaRange{ _mm_sub_ps(lumaMax, lumaMin) };
+				const __m128 isEdge{ _mm_cmpge_ps(lumaRange, _mm_max_ps(_mm_set1_ps(edgeThresholdMin), _mm_mul_ps(lumaMax, _mm_set1_ps(edgeThreshold)))) };
+				const int edgeMask{ _mm_movemask_ps(isEdge) & ((1 << nrLanes) - 1) };
+
+				if (edgeMask != 0)
+				{
+					const __m128 lumaNW{ load(pRowUp, -1) };
+					const __m128 lumaNE{ load(pRowUp, 1) };
+					const __m128 lumaSW{ load(pRowDown, -1) };
+					const __m128 lumaSE{ load(pRowDown, 1) };
+
+					//Second derivatives, a horizontal edge changes from row to row
+					const auto secondDerivative = [&](__m128 center, __m128 side0, __m128 side1)
+					{
+						return absolute(_mm_sub_ps(_mm_add_ps(side0, side1), _mm_mul_ps(two, center)));
+					};
+					const __m128 horizontal{ _mm_add_ps(_mm_mul_ps(two, secondDerivative(lumaM, lumaN, lumaS)),
+						_mm_add_ps(secondDerivative(lumaW, lumaNW, lumaSW), secondDerivative(lumaE, lumaNE, lumaSE))) };
+					const __m128 vertical{ _mm_add_ps(_mm_mul_ps(two, secondDerivative(lumaM, lumaW, lumaE)),
+						_mm_add_ps(secondDerivative(lumaN, lumaNW, lumaNE), secondDerivative(lumaS, lumaSW, lumaSE))) };
+					const __m128 isHorizontal{ _mm_cmpge_ps(horizontal, vertical) };
+
+					//The pixels across the edge, the first one is above or left
+					const __m128 luma1{ select(isHorizontal, lumaN, lumaW) };
+					const __m128 luma2{ select(isHorizontal, lumaS, lumaE) };
+					const __m128 gradient1{ absolute(_mm_sub_ps(luma1, lumaM)) };
+					const __m128 gradient2{ absolute(_mm_sub_ps(luma2, lumaM)) };
+					const __m128 is1Steepest{ _mm_cmpge_ps(gradient1, gradient2) };
+
+					alignas(16) float centerLumas[4], localAverages[4], scaledGradients[4], subpixelOffsets[4];
+					_mm_store_ps(centerLumas, lumaM);
+					_mm_store_ps(localAverages, _mm_mul_ps(_mm_set1_ps(0.5f), _mm_add_ps(select(is1Steepest, luma1, luma2), lumaM)));
+					_mm_store_ps(scaledGradients, _mm_mul_ps(_mm_set1_ps(0.25f), _mm_max_ps(gradient1, gradient2)));
+
+					//Subpixel aliasing, how much the center stands out from the average of its 3x3 neighbourhood
+					const __m128 lumaAverage{ _mm_mul_ps(_mm_set1_ps(1.0f / 12), _mm_add_ps(
+						_mm_mul_ps(two, _mm_add_ps(_mm_add_ps(lumaN, lumaS), _mm_add_ps(lumaW, lumaE))),
+						_mm_add_ps(_mm_add_ps(lumaNW, lumaNE), _mm_add_ps(lumaSW, lumaSE)))) };
+					const __m128 contrast{ _mm_min_ps(_mm_max_ps(_mm_div_ps(absolute(_mm_sub_ps(lumaAverage, lumaM)), lumaRange), zero), one) };
+					const __m128 smoothContrast{ _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(3.f), _mm_mul_ps(two, contrast)), _mm_mul_ps(contrast, contrast)) };
+					_mm_store_ps(subpixelOffsets, _mm_mul_ps(_mm_mul_ps(smoothContrast, smoothContrast), _mm_set1_ps(subpixelQuality)));
+
+					const int horizontalMask{ _mm_movemask_ps(isHorizontal) };
+					const int steepestMask{ _mm_movemask_ps(is1Steepest) };
+
+					//Only the edge pixels search for the ends of their edge
+					for (int laneMask{ edgeMask }; laneMask != 0; laneMask &= laneMask - 1)
+					{
+						const int lane{ std::countr_zero(static_cast<unsigned int>(laneMask)) };
+						const int x{ px + lane };
+						const bool isHorizontalEdge{ ((horizontalMask >> lane) & 1) != 0 };
+						const int stepAcross{ ((steepestMask >> lane) & 1) != 0 ? -1 : 1 };
+						const float localAverage{ localAverages[lane] };
+
+						//The lumas on both sides of the edge, walked along it from this pixel
+						const int stride{ isHorizontalEdge ? 1 : m_Width };
+						const float* pSide0{ isHorizontalEdge ? pRow : pLuma + x };
+						const float* pSide1{ isHorizontalEdge ?
+							pLuma + std::clamp(py + stepAcross, 0, height - 1) * m_Width :
+							pLuma + std::clamp(x + stepAcross, 0, width - 1) };
+						const auto edgeLuma = [&](int along)
+						{
+							return (pSide0[along * stride] + pSide1[along * stride]) * 0.5f - localAverage;
+						};
+
+						//Walk both ways until the luma along the edge changes as much as across it
+						const int start{ isHorizontalEdge ? x : py };
+						const int last{ (isHorizontalEdge ? width : height) - 1 };
+						int position1{ start }, position2{ start };
+						float lumaEnd1{}, lumaEnd2{};
+						for (int step : searchSteps)
+						{
+							position1 = std::max(position1 - step, 0);
+							lumaEnd1 = edgeLuma(position1);
+							if (std::abs(lumaEnd1) >= scaledGradients[lane] || position1 == 0)
+								break;
+						}
+						for (int step : searchSteps)
+						{
+							position2 = std::min(position2 + step, last);
+							lumaEnd2 = edgeLuma(position2);
+							if (std::abs(lumaEnd2) >= scaledGradients[lane] || position2 == last)
+								break;
+						}
+
+						//Pixels near the closer end blend the most, only when that end turns towards the other side of the edge
+						const int distance1{ start - position1 };
+						const int distance2{ position2 - start };
+						const bool isDirection1{ distance1 < distance2 };
+						const float edgeOffset{ 0.5f - static_cast<float>(std::min(distance1, distance2)) / std::max(distance1 + distance2, 1) };
+						const bool isCenterSmaller{ centerLumas[lane] < localAverage };
+						const bool isCorrectVariation{ ((isDirection1 ? lumaEnd1 : lumaEnd2) < 0.0f) != isCenterSmaller };
+						const float offset{ std::max(isCorrectVariation ? edgeOffset : 0.0f, subpixelOffsets[lane]) };
+
+						ColorRGB across{ ReadColor(static_cast<int>(pSide1 - pLuma) + start * stride) };
+						across.MaxToOne();
+						filtered[0][lane] += (across.r - filtered[0][lane]) * offset;
+						filtered[1][lane] += (across.g - filtered[1][lane]) * offset;
+						filtered[2][lane] += (across.b - filtered[2][lane]) * offset;
+					}
+				}
+
+				if (nrLanes == 4)
+				{
+					_mm_storeu_ps(m_FxaaRedPixels.data() + rowStart + px, _mm_load_ps(filtered[0]));
+					_mm_storeu_ps(m_FxaaGreenPixels.data() + rowStart + px, _mm_load_ps(filtered[1]));
+					_mm_storeu_ps(m_FxaaBluePixels.data() + rowStart + px, _mm_load_ps(filtered[2]));
+				}
+				else
+				{
+					for (int lane{}; lane < nrLanes; ++lane)
+					{
+						m_FxaaRedPixels[rowStart + px + lane] = filtered[0][lane];
+						m_FxaaGreenPixels[rowStart + px + lane] = filtered[1][lane];
+						m_FxaaBluePixels[rowStart + px + lane] = filtered[2][lane];
+					}
+				}
+			}
+		}
+	}
+}
\ No newline at end of file
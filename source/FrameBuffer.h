@@ -0,0 +1,231 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+#include "ColorRGB.h"
+
+struct SDL_Surface;
+struct SDL_PixelFormat;
+
+namespace dae
+{
+	//Channel layout of a 32 bit pixel format with 8 bits per channel, looked up once instead of per pixel
+	struct PackedPixelFormat
+	{
+		uint32_t redShift{ 16 };
+		uint32_t greenShift{ 8 };
+		uint32_t blueShift{ 0 };
+		uint32_t alphaMask{ 0 };
+
+		//Returns false when the SDL format can not be written as packed 8 bit channels
+		static bool FromSDL(const SDL_PixelFormat* pFormat, PackedPixelFormat& packedFormat);
+	};
+
+	enum class DepthFormat
+	{
+		Float32,
+		//Normalized integers, stored in 32 and 16 bits
+		Unorm24,
+		Unorm16,
+	};
+
+	//Depth of a triangle as a plane in screen space, evaluated relative to one of its vertices to keep the precision
+	struct DepthPlane
+	{
+		float originX{};
+		float originY{};
+		float depth{};
+		float gradientX{};
+		float gradientY{};
+
+		float At(float x, float y) const { return depth + (x - originX) * gradientX + (y - originY) * gradientY; };
+	};
+
+	//Plain in-memory color + depth target, does not depend on an SDL window
+	//Shading writes the float (HDR) color planes, Resolve converts them to packed 32 bit pixels once per frame
+	//With multisampling the color and depth planes hold a grid of samples, everything besides the packed pixels and the render size is addressed per sample
+	class FrameBuffer final
+	{
+	public:
+		FrameBuffer(int width, int height);
+		~FrameBuffer();
+
+		FrameBuffer(const FrameBuffer&) = delete;
+		FrameBuffer(FrameBuffer&&) noexcept = delete;
+		FrameBuffer& operator=(const FrameBuffer&) = delete;
+		FrameBuffer& operator=(FrameBuffer&&) noexcept = delete;
+
+		int GetWidth() const { return m_Width; };
+		int GetHeight() const { return m_Height; };
+		//Only the top left width x height pixels hold the rendered image, Resolve scales them up to the full size
+		void SetRenderSize(int width, int height);
+		int GetRenderWidth() const { return m_RenderWidth; };
+		int GetRenderHeight() const { return m_RenderHeight; };
+
+		//1 or 4 samples per pixel, in an ordered 2x2 grid. Reallocates the planes when the count changes, the content is undefined until the next clear
+		void SetSampleCount(int nrSamples);
+		int GetSampleCount() const { return m_SamplesPerSide * m_SamplesPerSide; };
+		int GetSamplesPerSide() const { return m_SamplesPerSide; };
+		//Size of the sample grid, the full size times the samples per side
+		int GetSampleWidth() const { return m_SampleWidth; };
+		int GetSampleHeight() const { return m_SampleHeight; };
+
+		uint32_t* GetColorPixels() { return m_ColorPixels.data(); };
+		const uint32_t* GetColorPixels() const { return m_ColorPixels.data(); };
+		//Depth is accessed per CoarseBlockSize x CoarseBlockSize block, which is also the unit of compression
+		//With compression a block that is cleared or covered by a single triangle only stores that state or plane, no pixels
+		static constexpr int CoarseBlockSize{ 8 };
+		static constexpr int NrBlockPixels{ CoarseBlockSize * CoarseBlockSize };
+
+		//Reallocates the depth storage when the format changes, the content is undefined until the next clear
+		void SetDepthFormat(DepthFormat format);
+		DepthFormat GetDepthFormat() const { return m_DepthFormat; };
+		int GetDepthBytesPerPixel() const { return m_DepthFormat == DepthFormat::Unorm16 ? 2 : 4; };
+		void SetDepthCompression(bool isCompressed) { m_IsDepthCompressed = isCompressed; };
+		//Cleared blocks decode to this value. Set once before the tiles clear their regions in parallel
+		void SetDepthClearValue(float depth) { m_DepthClearValue = QuantizeDepth(depth); };
+		bool IsDepthCompressed() const { return m_IsDepthCompressed; };
+
+		//Nearest depth the format can store, depth tests compare quantized values
+		float QuantizeDepth(float depth) const
+		{
+			switch (m_DepthFormat)
+			{
+			case DepthFormat::Unorm24:
+				return EncodeUnorm(depth, m_MaxUnorm24) * (1.0f / m_MaxUnorm24);
+			case DepthFormat::Unorm16:
+				return EncodeUnorm(depth, m_MaxUnorm16) * (1.0f / m_MaxUnorm16);
+			default:
+				return depth;
+			}
+		}
+
+		//Decoded depth of a whole block into pBlockDepth (row stride CoarseBlockSize), pixels outside the buffer get the clear value
+		//Returns the number of depth bytes read from memory
+		int LoadDepthBlock(int blockX, int blockY, float* pBlockDepth) const;
+		//Writes quantized depths back as pixels, returns the number of bytes written
+		int StoreDepthBlock(int blockX, int blockY, const float* pBlockDepth);
+		//Whole block is covered by one triangle, only its plane is kept
+		void StoreDepthBlockPlane(int blockX, int blockY, const DepthPlane& plane);
+
+		//Hierarchical Z: farthest depth of every block
+		const float* GetCoarseDepthPixels() const { return m_CoarseDepthPixels.data(); };
+		int GetCoarseWidth() const { return m_CoarseWidth; };
+		//Farthest depth of a block after it changed
+		void UpdateCoarseDepth(int blockX, int blockY, const float* pBlockDepth, bool isReversedZ);
+
+		//SDL view over the color pixels (XRGB8888), used for blitting and saving
+		SDL_Surface* GetSurface() const { return m_pSurface; };
+
+		void WriteColor(int pixelIndex, const ColorRGB& color)
+		{
+			m_RedPixels[pixelIndex] = color.r;
+			m_GreenPixels[pixelIndex] = color.g;
+			m_BluePixels[pixelIndex] = color.b;
+		}
+		ColorRGB ReadColor(int pixelIndex) const
+		{
+			return { m_RedPixels[pixelIndex], m_GreenPixels[pixelIndex], m_BluePixels[pixelIndex] };
+		}
+
+		//Clears color, depth and the coarse depth of the blocks overlapping the region [x0, x1) x [y0, y1) in one pass
+		//Non-temporal stores bypass the cache, for regions that are not read again soon
+		void Clear(const ColorRGB& color, float depth, bool isNonTemporal = true);
+		void ClearRegion(int x0, int y0, int x1, int y1, const ColorRGB& color, float depth, bool isNonTemporal);
+
+		//Image space anti-aliasing of the render size, for single sampled buffers. Allocates its planes when enabled
+		//Resolve reads the filtered colors instead, so the rendered ones stay untouched for the tiles that are kept next frame
+		void SetFxaa(bool isEnabled);
+		bool IsUsingFxaa() const { return !m_FxaaLumaPixels.empty(); };
+		//Per region, like the tiles. The filter reads the luma of the neighbouring regions, so every region needs its luma first
+		void CalculateFxaaLuma(int x0, int y0, int x1, int y1);
+		void ApplyFxaa(int x0, int y0, int x1, int y1);
+
+		//Scales colors above one back into range (like ColorRGB::MaxToOne) and packs them
+		//The samples of a pixel are averaged, then a smaller render size is filtered bilinearly up to the full size
+		void Resolve();
+		void Resolve(uint32_t* pDestination, int destinationPitch, const PackedPixelFormat& format);
+
+	private:
+		int m_Width{};
+		int m_Height{};
+		int m_RenderWidth{};
+		int m_RenderHeight{};
+		int m_SamplesPerSide{ 1 };
+		int m_SampleWidth{};
+		int m_SampleHeight{};
+
+		//Float color stored per channel, so a span of pixels can be packed with SIMD
+		std::vector<float> m_RedPixels{};
+		std::vector<float> m_GreenPixels{};
+		std::vector<float> m_BluePixels{};
+
+		std::vector<uint32_t> m_ColorPixels{};
+
+		//Luma of the in range colors and the filtered colors, per pixel of the full size
+		std::vector<float> m_FxaaLumaPixels{};
+		std::vector<float> m_FxaaRedPixels{};
+		std::vector<float> m_FxaaGreenPixels{};
+		std::vector<float> m_FxaaBluePixels{};
+
+		enum class DepthBlockState : uint8_t
+		{
+			Cleared,
+			Plane,
+			Pixels,
+		};
+
+		static constexpr uint32_t m_MaxUnorm24{ (1u << 24) - 1 };
+		static constexpr uint32_t m_MaxUnorm16{ (1u << 16) - 1 };
+
+		DepthFormat m_DepthFormat{ DepthFormat::Float32 };
+		bool m_IsDepthCompressed{ false };
+		float m_DepthClearValue{};
+
+		//Float bits or 24 bit unorm
+		std::vector<uint32_t> m_DepthPixels{};
+		std::vector<uint16_t> m_Depth16Pixels{};
+
+		int m_CoarseWidth{};
+		int m_CoarseHeight{};
+		std::vector<float> m_CoarseDepthPixels{};
+		std::vector<DepthBlockState> m_DepthBlockStates{};
+		std::vector<DepthPlane> m_DepthBlockPlanes{};
+
+		static uint32_t EncodeUnorm(float depth, uint32_t maxValue)
+		{
+			return static_cast<uint32_t>(std::clamp(depth, 0.0f, 1.0f) * maxValue + 0.5f);
+		}
+
+		uint32_t EncodeDepth32(float depth) const
+		{
+			return m_DepthFormat == DepthFormat::Unorm24 ? EncodeUnorm(depth, m_MaxUnorm24) : std::bit_cast<uint32_t>(depth);
+		}
+		float DecodeDepth32(uint32_t value) const
+		{
+			return m_DepthFormat == DepthFormat::Unorm24 ? value * (1.0f / m_MaxUnorm24) : std::bit_cast<float>(value);
+		}
+
+		SDL_Surface* m_pSurface{ nullptr };
+		PackedPixelFormat m_SurfaceFormat{};
+
+		//Scratch of Resolve, kept between frames. Horizontal taps per destination column when upscaling
+		std::vector<int> m_ResolveLeftColumns{};
+		std::vector<int> m_ResolveRightColumns{};
+		std::vector<float> m_ResolveRightWeights{};
+		//Rows of the render size and the full size, per channel
+		std::vector<float> m_ResolveBlendedRow{};
+		std::vector<float> m_ResolveScaledRow{};
+		//Two rows of averaged samples with MSAA
+		std::vector<float> m_ResolvedSampleRows{};
+
+		//Sizes the scratch of Resolve for the render size and sample count
+		void InitResolve();
+
+		//Averages the samples of every pixel in a row of the render size, each sample is scaled into range first
+		void ResolveSampleRow(int row, float* pRed, float* pGreen, float* pBlue) const;
+	};
+}
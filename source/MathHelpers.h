@@ -1,6 +1,10 @@
 #pragma once
 #include <cmath>
 #include <algorithm>
+#include <bit>
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
 
 namespace dae
 {
@@ -65,4 +69,55 @@ namespace dae
 		const float clamped{ std::clamp(val, min, max) };
 		return (clamped - min) / (max - min);
 	}
-}
\ No newline at end of file
+
+	//log2 of a positive normal float, absolute error below 1e-5
+	inline float FastLog2(float x)
+	{
+		const uint32_t bits{ std::bit_cast<uint32_t>(x) };
+		const float exponent{ static_cast<float>(static_cast<int>(bits >> 23) - 127) };
+		const float mantissa{ std::bit_cast<float>((bits & 0x007FFFFFu) | 0x3F800000u) };
+
+		//Polynomial on [1, 2), multiplied by (mantissa - 1) so log2(1) stays exactly 0
+		//Evaluated in pairs instead of Horner form, which halves the chain of dependent multiply adds
+		const float mantissa2{ mantissa * mantissa };
+		const float polynomial{ (3.1157899f - 3.3241990f * mantissa) + (2.5988452f - 1.2315303f * mantissa) * mantissa2
+			+ (3.1821337e-1f - 3.4436006e-2f * mantissa) * mantissa2 * mantissa2 };
+		return polynomial * (mantissa - 1.0f) + exponent;
+	}
+
+	//2^x for x < 128, relative error below 1e-7, flushes to the smallest normal below -126
+	inline float FastExp2(float x)
+	{
+		x = x > -126.0f ? x : -126.0f;
+		const float integer{ std::floor(x) };
+		const float fraction{ x - integer };
+
+		const float fraction2{ fraction * fraction };
+		const float polynomial{ (9.9999994e-1f + 6.9315308e-1f * fraction) + (2.4015361e-1f + 5.5826318e-2f * fraction) * fraction2
+			+ (8.9893397e-3f + 1.8775767e-3f * fraction) * fraction2 * fraction2 };
+		return polynomial * std::bit_cast<float>(static_cast<uint32_t>(static_cast<int>(integer) + 127) << 23);
+	}
+
+	//powf without branches or library calls, for a base in [0, 1]
+	//Absolute error below 1.5e-4 for exponents up to 25, base 0 is exact like powf
+	inline float FastPow(float base, float exponent)
+	{
+		const float result{ FastExp2(exponent * FastLog2(base > FLT_MIN ? base : FLT_MIN)) };
+		return base > 0.0f || exponent == 0.0f ? result : 0.0f;
+	}
+
+	//FNV-1a, to notice changes of plain data without keeping a copy of it
+	inline uint64_t HashBytes(const void* pData, size_t size, uint64_t hash = 14695981039346656037ull)
+	{
+		const uint8_t* pBytes{ static_cast<const uint8_t*>(pData) };
+		for (size_t i{}; i < size; ++i)
+			hash = (hash ^ pBytes[i]) * 1099511628211ull;
+		return hash;
+	}
+
+	template<typename T>
+	uint64_t HashValue(const T& value, uint64_t hash = 14695981039346656037ull)
+	{
+		return HashBytes(&value, sizeof(T), hash);
+	}
+}
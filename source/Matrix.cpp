@@ -144,11 +144,22 @@ namespace dae {
 
 	Matrix Matrix::CreateLookAtLH(const Vector3& origin, const Vector3& forward, const Vector3& worldUp)
 	{
-		//TODO W1
 		Vector3 right = Vector3::Cross(worldUp, forward).Normalized();
 		Vector3 up = Vector3::Cross(forward, right);
 
-		return{};
+		//Inverse of the camera's ONB, same as Camera::CalculateViewMatrix
+		return Inverse(Matrix{ right, up, forward, origin });
+	}
+
+	Matrix Matrix::CreateOrthographicLH(float width, float height, float zn, float zf)
+	{
+		float frustrunDepth{ zf - zn };
+		return {
+			{2 / width, 0, 0, 0},
+			{0, 2 / height, 0, 0},
+			{0, 0, 1 / frustrunDepth, 0},
+			{0, 0, -zn / frustrunDepth, 1}
+		};
 	}
 
 	Matrix Matrix::CreatePerspectiveFovLH(float fov, float aspect, float zn, float zf)
@@ -163,6 +174,17 @@ namespace dae {
 		};
 	}
 
+	Matrix Matrix::CreatePerspectiveFovLHReversedZ(float fov, float aspect, float zn, float zf)
+	{
+		float frustrunDepth{ zf - zn };
+		return {
+			{1 / (fov * aspect), 0, 0, 0},
+			{0, 1 / fov, 0, 0},
+			{0, 0, -zn / frustrunDepth, 1},
+			{0, 0, (zf * zn) / frustrunDepth, 0}
+		};
+	}
+
 	Vector3 Matrix::GetAxisX() const
 	{
 		return data[0];
@@ -49,7 +49,11 @@ namespace dae {
 		static Matrix Inverse(const Matrix& m);
 
 		static Matrix CreateLookAtLH(const Vector3& origin, const Vector3& forward, const Vector3& worldUp);
+		//Depth is linear, 0 at the near plane and 1 at the far plane
+		static Matrix CreateOrthographicLH(float width, float height, float zn, float zf);
 		static Matrix CreatePerspectiveFovLH(float fovy, float aspect, float zn, float zf);
+		//Maps the near plane to depth 1 and the far plane to 0, spreads float precision evenly over the distance
+		static Matrix CreatePerspectiveFovLHReversedZ(float fovy, float aspect, float zn, float zf);
 
 		Vector4& operator[](int index);
 		Vector4 operator[](int index) const;
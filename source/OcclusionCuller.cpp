@@ -0,0 +1,69 @@
+#include "OcclusionCuller.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace dae
+{
+	OcclusionCuller::OcclusionCuller(int width, int height, int downscale) :
+		m_ScreenWidth{ width },
+		m_ScreenHeight{ height },
+		m_Rasterizer{ width, height, downscale, true }
+	{
+	}
+
+	OcclusionCuller::Visibility OcclusionCuller::TestBounds(const Matrix& worldViewProjection, const Vector3& boundsMin, const Vector3& boundsMax) const
+	{
+		Vector3 minNdc{ FLT_MAX, FLT_MAX, FLT_MAX };
+		Vector3 maxNdc{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+		for (int corner{}; corner < 8; ++corner)
+		{
+			const Vector4 position{ worldViewProjection.TransformPoint(
+				corner & 1 ? boundsMax.x : boundsMin.x,
+				corner & 2 ? boundsMax.y : boundsMin.y,
+				corner & 4 ? boundsMax.z : boundsMin.z,
+				1.0f) };
+
+			//The box reaches behind the camera, its projection is unbounded
+			if (position.w <= 0.0f)
+				return Visibility::Visible;
+
+			const Vector3 ndc{ position.x / position.w, position.y / position.w, position.z / position.w };
+			minNdc = { std::min(minNdc.x, ndc.x), std::min(minNdc.y, ndc.y), std::min(minNdc.z, ndc.z) };
+			maxNdc = { std::max(maxNdc.x, ndc.x), std::max(maxNdc.y, ndc.y), std::max(maxNdc.z, ndc.z) };
+		}
+
+		if (maxNdc.x < -1.0f || minNdc.x > 1.0f || maxNdc.y < -1.0f || minNdc.y > 1.0f || maxNdc.z < 0.0f || minNdc.z > 1.0f)
+			return Visibility::OutsideFrustum;
+
+		const float nearestDepth{ m_Rasterizer.IsReversedZ() ? maxNdc.z : minNdc.z };
+		const int downscale{ m_Rasterizer.GetDownscale() };
+		const int width{ m_Rasterizer.GetWidth() }, height{ m_Rasterizer.GetHeight() };
+		const float* pDepthPixels{ m_Rasterizer.GetDepthPixels() };
+
+		//Grown by one pixel, coverage is only sampled at the pixel centers so occluder silhouettes can be off by up to a pixel
+		const int startX{ std::max(static_cast<int>(std::floor((minNdc.x + 1) * 0.5f * m_ScreenWidth / downscale)) - 1, 0) };
+		const int endX{ std::min(static_cast<int>(std::floor((maxNdc.x + 1) * 0.5f * m_ScreenWidth / downscale)) + 1, width - 1) };
+		const int startY{ std::max(static_cast<int>(std::floor((1.0f - maxNdc.y) * 0.5f * m_ScreenHeight / downscale)) - 1, 0) };
+		const int endY{ std::min(static_cast<int>(std::floor((1.0f - minNdc.y) * 0.5f * m_ScreenHeight / downscale)) + 1, height - 1) };
+
+		for (int y{ startY }; y <= endY; ++y)
+		{
+			for (int x{ startX }; x <= endX; ++x)
+			{
+				if (!m_Rasterizer.IsCloser(pDepthPixels[x + y * width], nearestDepth))
+					return Visibility::Visible;
+			}
+		}
+
+		return Visibility::Occluded;
+	}
+
+	int OcclusionCuller::RasterizeOccluder(const Matrix& worldViewProjection, const std::vector<Vector3>& positions, const std::vector<uint32_t>& indices)
+	{
+		PROFILE_SCOPE("Occluder");
+		return m_Rasterizer.RasterizeTriangles(worldViewProjection, positions, indices);
+	}
+}
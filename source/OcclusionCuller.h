@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "DepthRasterizer.h"
+#include "Math.h"
+
+namespace dae
+{
+	//Low resolution depth buffer that whole meshes are tested against before their triangles are submitted
+	//Meshes are handled front to back: each one is tested first and, when visible, rasterized depth only as an occluder
+	class OcclusionCuller final
+	{
+	public:
+		enum class Visibility
+		{
+			Visible,
+			OutsideFrustum,
+			Occluded,
+		};
+
+		//One depth value per downscale x downscale block of framebuffer pixels
+		OcclusionCuller(int width, int height, int downscale);
+
+		void Clear(bool isReversedZ) { m_Rasterizer.Clear(isReversedZ); };
+
+		//Bounds are the object space box of the mesh
+		Visibility TestBounds(const Matrix& worldViewProjection, const Vector3& boundsMin, const Vector3& boundsMax) const;
+		//Only writes triangles the rasterizer draws as well, returns the number of triangles written
+		int RasterizeOccluder(const Matrix& worldViewProjection, const std::vector<Vector3>& positions, const std::vector<uint32_t>& indices);
+
+		//Nearest occluder depth per pixel, conservative: the farthest depth of the occluder over the whole pixel
+		const DepthRasterizer& GetDepthBuffer() const { return m_Rasterizer; };
+
+	private:
+		int m_ScreenWidth{};
+		int m_ScreenHeight{};
+		DepthRasterizer m_Rasterizer;
+	};
+}
@@ -0,0 +1,176 @@
+#include "Presenter.h"
+#include "Profiler.h"
+#include "SDL.h"
+#include <cassert>
+
+namespace dae
+{
+	Presenter::Presenter(SDL_Window* pWindow) :
+		m_pWindow{ pWindow }
+	{
+		//The window surface has to be requested on the thread that created the window
+		m_pWindowSurface = SDL_GetWindowSurface(pWindow);
+		assert(m_pWindowSurface && "Presenter needs a window surface.");
+
+		//Same format as the window surface, otherwise XRGB8888 and the blit converts
+		Uint32 pixelFormat{ SDL_PIXELFORMAT_RGB888 };
+		if (PackedPixelFormat::FromSDL(m_pWindowSurface->format, m_Format))
+			pixelFormat = m_pWindowSurface->format->format;
+		else
+			m_Format = PackedPixelFormat{};
+
+		for (int i{}; i < m_NrBuffers; ++i)
+		{
+			m_pBuffers[i] = SDL_CreateRGBSurfaceWithFormat(0, m_pWindowSurface->w, m_pWindowSurface->h, 32, pixelFormat);
+			assert(m_pBuffers[i] && "Presenter buffer failed to create.");
+			m_FreeBuffers.Push(i);
+		}
+
+		m_Thread = std::thread{ &Presenter::ThreadLoop, this };
+	}
+
+	Presenter::~Presenter()
+	{
+		//A frame waiting for a free buffer is dropped, the window does not present anymore
+		m_IsStopping = true;
+		++m_NrReleased;
+		m_NrReleased.notify_one();
+		++m_NrSubmitted;
+		m_NrSubmitted.notify_one();
+
+		m_Thread.join();
+
+		for (SDL_Surface* pBuffer : m_pBuffers)
+			SDL_FreeSurface(pBuffer);
+	}
+
+	bool Presenter::Present()
+	{
+		//In order, every submitted frame is shown by the next call even when its resolve has to be waited for
+		if (!m_DropStaleFrames)
+			WaitForResolve();
+
+		int bufferIndex{};
+		if (!m_ReadyBuffers.Pop(bufferIndex))
+			return false;
+
+		//Frames that got resolved since the last present are already outdated
+		int newerBufferIndex{};
+		while (m_ReadyBuffers.Pop(newerBufferIndex))
+		{
+			ReleaseBuffer(bufferIndex);
+			++m_NrDroppedFrames;
+			bufferIndex = newerBufferIndex;
+		}
+
+		SDL_BlitSurface(m_pBuffers[bufferIndex], nullptr, m_pWindowSurface, nullptr);
+		SDL_UpdateWindowSurface(m_pWindow);
+
+		++m_NrPresentedFrames;
+		ReleaseBuffer(bufferIndex);
+		return true;
+	}
+
+	void Presenter::Submit(FrameBuffer* pFrameBuffer)
+	{
+		//One frame buffer at a time, a frame that would wait for the previous one is dropped when dropping stale frames
+		if (m_NrResolved != m_NrSubmitted)
+		{
+			if (m_DropStaleFrames)
+			{
+				++m_NrDroppedFrames;
+				return;
+			}
+
+			WaitForResolve();
+		}
+
+		//The present thread reads the pointer once it sees the new count
+		m_pSubmittedFrameBuffer = pFrameBuffer;
+
+		++m_NrSubmitted;
+		m_NrSubmitted.notify_one();
+	}
+
+	void Presenter::WaitForResolve()
+	{
+		//Only the window thread submits, so the count can not change while waiting
+		const uint32_t nrSubmitted{ m_NrSubmitted };
+		uint32_t nrResolved{ m_NrResolved };
+		if (nrResolved == nrSubmitted)
+			return;
+
+		PROFILE_SCOPE("WaitForResolve");
+		while (nrResolved != nrSubmitted)
+		{
+			m_NrResolved.wait(nrResolved);
+			nrResolved = m_NrResolved;
+		}
+	}
+
+	void Presenter::WaitForResolve(const FrameBuffer* pFrameBuffer)
+	{
+		if (pFrameBuffer == m_pSubmittedFrameBuffer)
+			WaitForResolve();
+	}
+
+	int Presenter::AcquireBuffer()
+	{
+		int bufferIndex{};
+		while (!m_FreeBuffers.Pop(bufferIndex))
+		{
+			//Every buffer is resolved and not presented yet
+			if (m_DropStaleFrames || m_IsStopping)
+			{
+				++m_NrDroppedFrames;
+				return -1;
+			}
+
+			//Checked again after reading the counter, a release in between makes the wait return right away
+			const uint32_t nrReleased{ m_NrReleased };
+			if (m_FreeBuffers.Pop(bufferIndex))
+				break;
+
+			PROFILE_SCOPE("WaitForPresent");
+			m_NrReleased.wait(nrReleased);
+		}
+
+		return bufferIndex;
+	}
+
+	void Presenter::ReleaseBuffer(int bufferIndex)
+	{
+		m_FreeBuffers.Push(bufferIndex);
+
+		++m_NrReleased;
+		m_NrReleased.notify_one();
+	}
+
+	void Presenter::ThreadLoop()
+	{
+		PROFILE_THREAD_NAME("Present");
+
+		uint32_t nrResolved{};
+		while (true)
+		{
+			//Returns once a frame buffer was submitted, or the presenter stops
+			m_NrSubmitted.wait(nrResolved);
+			if (m_IsStopping)
+				return;
+
+			const int bufferIndex{ AcquireBuffer() };
+			if (bufferIndex >= 0)
+			{
+				PROFILE_SCOPE("Resolve");
+				SDL_Surface* pBuffer{ m_pBuffers[bufferIndex] };
+				m_pSubmittedFrameBuffer->Resolve(static_cast<uint32_t*>(pBuffer->pixels), pBuffer->pitch, m_Format);
+
+				//Can not fail, the queue holds every buffer
+				m_ReadyBuffers.Push(bufferIndex);
+			}
+
+			m_NrResolved = ++nrResolved;
+			m_NrResolved.notify_one();
+		}
+	}
+}
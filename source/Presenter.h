@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "FrameBuffer.h"
+#include "SpscQueue.h"
+
+struct SDL_Window;
+struct SDL_Surface;
+
+namespace dae
+{
+	//Resolves finished frames on its own thread, so the render loop does not wait for the conversion to packed pixels
+	//Triple buffered: the present thread resolves into a free buffer while the others are queued for the window
+	//SDL only supports window surface calls on the thread that created the window, so the blit and update stay on the render thread
+	class Presenter final
+	{
+	public:
+		explicit Presenter(SDL_Window* pWindow);
+		~Presenter();
+
+		Presenter(const Presenter&) = delete;
+		Presenter(Presenter&&) noexcept = delete;
+		Presenter& operator=(const Presenter&) = delete;
+		Presenter& operator=(Presenter&&) noexcept = delete;
+
+		//Layout of the buffers, same as the window surface when possible so presenting is a plain copy
+		const PackedPixelFormat& GetFormat() const { return m_Format; };
+
+		//Window thread only. Copies the newest resolved frame to the window, returns false when none was ready
+		bool Present();
+		//Window thread only. Resolves the frame buffer on the present thread, it may not change until WaitForResolve returns
+		void Submit(FrameBuffer* pFrameBuffer);
+		//Window thread only. Waits until the submitted frame buffer is resolved, or only when it is this one
+		void WaitForResolve();
+		void WaitForResolve(const FrameBuffer* pFrameBuffer);
+
+		//Instead of showing every frame in order, frames are dropped rather than waiting for the present thread
+		void SetDropStaleFrames(bool dropStaleFrames) { m_DropStaleFrames = dropStaleFrames; };
+		bool IsDroppingStaleFrames() const { return m_DropStaleFrames; };
+
+		uint64_t GetNrPresentedFrames() const { return m_NrPresentedFrames; };
+		uint64_t GetNrDroppedFrames() const { return m_NrDroppedFrames; };
+
+	private:
+		static constexpr int m_NrBuffers{ 3 };
+
+		SDL_Window* m_pWindow{};
+		SDL_Surface* m_pWindowSurface{ nullptr };
+		SDL_Surface* m_pBuffers[m_NrBuffers]{};
+		PackedPixelFormat m_Format{};
+
+		SpscQueue<int, m_NrBuffers> m_ReadyBuffers{};
+		SpscQueue<int, m_NrBuffers> m_FreeBuffers{};
+
+		//Written before m_NrSubmitted is bumped, the present thread reads it after seeing the new count
+		FrameBuffer* m_pSubmittedFrameBuffer{ nullptr };
+		//Bumped on every submit/resolve/release, the other thread sleeps on them while it has to wait
+		std::atomic<uint32_t> m_NrSubmitted{};
+		std::atomic<uint32_t> m_NrResolved{};
+		std::atomic<uint32_t> m_NrReleased{};
+
+		std::atomic<bool> m_DropStaleFrames{ false };
+		std::atomic<bool> m_IsStopping{ false };
+		std::atomic<uint64_t> m_NrPresentedFrames{};
+		std::atomic<uint64_t> m_NrDroppedFrames{};
+
+		std::thread m_Thread{};
+
+		void ThreadLoop();
+		//Waits for a free buffer, or returns -1 (frame dropped) when dropping stale frames
+		int AcquireBuffer();
+		void ReleaseBuffer(int bufferIndex);
+	};
+}
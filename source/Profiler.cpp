@@ -0,0 +1,157 @@
+#include "Profiler.h"
+#include <SDL_timer.h>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+namespace dae
+{
+	Profiler& Profiler::GetInstance()
+	{
+		static Profiler instance{};
+		return instance;
+	}
+
+	Profiler::Profiler() :
+		m_MicrosecondsPerCount{ 1000000.0 / static_cast<double>(SDL_GetPerformanceFrequency()) }
+	{
+	}
+
+	uint64_t Profiler::GetTimestamp()
+	{
+		return SDL_GetPerformanceCounter();
+	}
+
+	//Hands the thread's buffer back when the thread exits
+	struct Profiler::ThreadBufferOwner final
+	{
+		ThreadBuffer* pBuffer{ nullptr };
+
+		~ThreadBufferOwner()
+		{
+			if (pBuffer)
+				GetInstance().ReleaseThreadBuffer(*pBuffer);
+		}
+	};
+
+	void Profiler::Record(const char* name, uint64_t start, uint64_t end)
+	{
+		ThreadBuffer& buffer{ GetThreadBuffer() };
+
+		//Oldest events get overwritten once the ring buffer is full
+		const uint64_t nrWritten{ buffer.nrWritten.load(std::memory_order_relaxed) };
+		EventSlot& slot{ buffer.pEvents[nrWritten % m_EventsPerThread] };
+
+		//A save that reads part of this event is guaranteed to see the count it started at afterwards
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.name.store(name, std::memory_order_relaxed);
+		slot.start.store(start, std::memory_order_relaxed);
+		slot.end.store(end, std::memory_order_relaxed);
+		buffer.nrWritten.store(nrWritten + 1, std::memory_order_release);
+	}
+
+	void Profiler::SetThreadName(const std::string& name)
+	{
+		ThreadBuffer& buffer{ GetThreadBuffer() };
+
+		std::lock_guard lock{ m_Mutex };
+		buffer.name = name;
+	}
+
+	Profiler::ThreadBuffer& Profiler::GetThreadBuffer()
+	{
+		thread_local ThreadBufferOwner owner{};
+
+		if (!owner.pBuffer)
+		{
+			std::lock_guard lock{ m_Mutex };
+
+			//Reused, so recreating the worker threads does not grow the profiler, the new thread continues the ring
+			const auto freeBufferIt{ std::find_if(m_pThreadBuffers.begin(), m_pThreadBuffers.end(),
+				[](const std::unique_ptr<ThreadBuffer>& pBuffer) { return !pBuffer->isInUse; }) };
+			if (freeBufferIt != m_pThreadBuffers.end())
+			{
+				owner.pBuffer = freeBufferIt->get();
+			}
+			else
+			{
+				auto pNewBuffer{ std::make_unique<ThreadBuffer>() };
+				pNewBuffer->pEvents = std::make_unique<EventSlot[]>(m_EventsPerThread);
+				pNewBuffer->threadId = static_cast<uint32_t>(m_pThreadBuffers.size());
+
+				owner.pBuffer = pNewBuffer.get();
+				m_pThreadBuffers.push_back(std::move(pNewBuffer));
+			}
+
+			owner.pBuffer->name = owner.pBuffer->threadId == 0 ? "Main" : "Thread " + std::to_string(owner.pBuffer->threadId);
+			owner.pBuffer->isInUse = true;
+		}
+
+		return *owner.pBuffer;
+	}
+
+	void Profiler::ReleaseThreadBuffer(ThreadBuffer& buffer)
+	{
+		std::lock_guard lock{ m_Mutex };
+		buffer.isInUse = false;
+	}
+
+	bool Profiler::SaveChromeTrace(const std::string& path) const
+	{
+		std::lock_guard lock{ m_Mutex };
+
+		std::ofstream file(path);
+		if (!file)
+			return false;
+
+		//Copied first, the threads keep recording while the file is written
+		std::vector<std::vector<Event>> threadEvents(m_pThreadBuffers.size());
+		uint64_t firstTimestamp{ UINT64_MAX };
+		for (size_t bufferIndex{}; bufferIndex < m_pThreadBuffers.size(); ++bufferIndex)
+		{
+			const ThreadBuffer& buffer{ *m_pThreadBuffers[bufferIndex] };
+			std::vector<Event>& events{ threadEvents[bufferIndex] };
+
+			//Oldest first, so the trace reads in order
+			const uint64_t nrWritten{ buffer.nrWritten.load(std::memory_order_acquire) };
+			const uint64_t firstEvent{ nrWritten - std::min<uint64_t>(nrWritten, m_EventsPerThread) };
+			for (uint64_t i{ firstEvent }; i < nrWritten; ++i)
+			{
+				const EventSlot& slot{ buffer.pEvents[i % m_EventsPerThread] };
+				events.push_back(Event{ slot.name.load(std::memory_order_relaxed), slot.start.load(std::memory_order_relaxed), slot.end.load(std::memory_order_relaxed) });
+			}
+
+			//Events the thread started overwriting while they were copied are dropped, event i is overwritten once the count reaches i + m_EventsPerThread
+			std::atomic_thread_fence(std::memory_order_acquire);
+			const uint64_t nrWrittenAfter{ buffer.nrWritten.load(std::memory_order_relaxed) };
+			const uint64_t firstIntact{ nrWrittenAfter < m_EventsPerThread ? 0 : nrWrittenAfter - m_EventsPerThread + 1 };
+			if (firstIntact > firstEvent)
+				events.erase(events.begin(), events.begin() + std::min<uint64_t>(firstIntact - firstEvent, events.size()));
+
+			for (const Event& event : events)
+				firstTimestamp = std::min(firstTimestamp, event.start);
+		}
+
+		file << std::fixed << std::setprecision(3);
+		file << "{\"traceEvents\":[\n";
+
+		for (size_t bufferIndex{}; bufferIndex < m_pThreadBuffers.size(); ++bufferIndex)
+		{
+			const ThreadBuffer& buffer{ *m_pThreadBuffers[bufferIndex] };
+			file << (bufferIndex == 0 ? "" : ",\n")
+				<< "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << buffer.threadId
+				<< ",\"args\":{\"name\":\"" << buffer.name << "\"}}";
+
+			for (const Event& event : threadEvents[bufferIndex])
+			{
+				file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer.threadId
+					<< ",\"ts\":" << (event.start - firstTimestamp) * m_MicrosecondsPerCount
+					<< ",\"dur\":" << (event.end - event.start) * m_MicrosecondsPerCount << "}";
+			}
+		}
+
+		file << "\n]}\n";
+
+		return static_cast<bool>(file);
+	}
+}
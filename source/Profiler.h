@@ -0,0 +1,114 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//Comment out to compile all profile markers out of the build
+#define RASTERIZER_PROFILE
+
+namespace dae
+{
+	//Collects timed events per thread in ring buffers and exports them as chrome://tracing JSON
+	class Profiler final
+	{
+	public:
+		struct Event
+		{
+			const char* name{};
+			uint64_t start{};
+			uint64_t end{};
+		};
+
+		static Profiler& GetInstance();
+
+		Profiler(const Profiler&) = delete;
+		Profiler(Profiler&&) noexcept = delete;
+		Profiler& operator=(const Profiler&) = delete;
+		Profiler& operator=(Profiler&&) noexcept = delete;
+
+		static uint64_t GetTimestamp();
+
+		//Name must be a string literal, only the pointer is stored
+		void Record(const char* name, uint64_t start, uint64_t end);
+		void SetThreadName(const std::string& name);
+
+		//Writes the events still in the ring buffers, other threads can keep recording meanwhile
+		bool SaveChromeTrace(const std::string& path) const;
+
+	private:
+		Profiler();
+		~Profiler() = default;
+
+		//Saving can read a slot while its thread overwrites it, the torn copy is detected and dropped
+		struct EventSlot
+		{
+			std::atomic<const char*> name{};
+			std::atomic<uint64_t> start{};
+			std::atomic<uint64_t> end{};
+		};
+
+		//Every thread writes to its own buffer, so recording needs no locking
+		struct ThreadBuffer
+		{
+			std::unique_ptr<EventSlot[]> pEvents{};
+			//Only its thread writes it, after the event, so saving only reads events that are complete
+			std::atomic<uint64_t> nrWritten{};
+			uint32_t threadId{};
+			std::string name{};
+			//Buffers of threads that exited are handed to new threads
+			bool isInUse{};
+		};
+		struct ThreadBufferOwner;
+
+		static constexpr size_t m_EventsPerThread{ 1 << 16 };
+
+		mutable std::mutex m_Mutex{};
+		std::vector<std::unique_ptr<ThreadBuffer>> m_pThreadBuffers{};
+		double m_MicrosecondsPerCount{};
+
+		ThreadBuffer& GetThreadBuffer();
+		void ReleaseThreadBuffer(ThreadBuffer& buffer);
+	};
+
+	class ProfileScope final
+	{
+	public:
+		explicit ProfileScope(const char* name) :
+			m_Name{ name },
+			m_Start{ Profiler::GetTimestamp() }
+		{
+		}
+
+		~ProfileScope()
+		{
+			Profiler::GetInstance().Record(m_Name, m_Start, Profiler::GetTimestamp());
+		}
+
+		ProfileScope(const ProfileScope&) = delete;
+		ProfileScope(ProfileScope&&) noexcept = delete;
+		ProfileScope& operator=(const ProfileScope&) = delete;
+		ProfileScope& operator=(ProfileScope&&) noexcept = delete;
+
+	private:
+		const char* m_Name;
+		uint64_t m_Start;
+	};
+}
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef RASTERIZER_PROFILE
+#define PROFILE_SCOPE(name) dae::ProfileScope PROFILE_CONCAT(profileScope, __LINE__){ name }
+#define PROFILE_EVENT(name, start, end) dae::Profiler::GetInstance().Record(name, start, end)
+#define PROFILE_THREAD_NAME(name) dae::Profiler::GetInstance().SetThreadName(name)
+#define PROFILE_SAVE(path) dae::Profiler::GetInstance().SaveChromeTrace(path)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_EVENT(name, start, end)
+#define PROFILE_THREAD_NAME(name)
+#define PROFILE_SAVE(path) false
+#endif
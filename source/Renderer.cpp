@@ -5,11 +5,19 @@
 //Project includes
 #include "Renderer.h"
 #include "Math.h"
+#include "Profiler.h"
+#include "SimdHelpers.h"
+#include "DepthRasterizer.h"
 #include "Matrix.h"
+#include "OcclusionCuller.h"
+#include "Presenter.h"
 #include "Texture.h"
 #include "Utils.h"
+#include "WorkerPool.h"
 #include <algorithm>
+#include <bit>
 #include <iostream>
+#include <thread>
 
 using namespace dae;
 
@@ -22,12 +30,66 @@ Renderer::Renderer(SDL_Window* pWindow) :
 	//Initialize
 	SDL_GetWindowSize(pWindow, &m_Width, &m_Height);
 
-	//Create Buffers
 	m_pFrontBuffer = SDL_GetWindowSurface(pWindow);
-	m_pBackBuffer = SDL_CreateRGBSurface(0, m_Width, m_Height, 32, 0, 0, 0, 0);
-	m_pBackBufferPixels = (uint32_t*)m_pBackBuffer->pixels;
 
-	m_pDepthBufferPixels = new float[m_Width * m_Height];
+	//Resolving straight into the window surface only works when it is a packed 32 bit surface of the same size
+	m_CanPresentDirectly = m_pFrontBuffer &&
+		m_pFrontBuffer->w == m_Width && m_pFrontBuffer->h == m_Height &&
+		PackedPixelFormat::FromSDL(m_pFrontBuffer->format, m_FrontBufferFormat);
+
+	Initialize();
+
+	//Resolve on a separate thread by default, the render loop continues with the next frame right away
+	m_pPresenter = new Presenter{ pWindow };
+	InitFrames();
+}
+
+Renderer::Renderer(int width, int height) :
+	m_Width(width),
+	m_Height(height)
+{
+	Initialize();
+}
+
+Renderer::~Renderer()
+{
+	//Workers might still be rasterizing the last pipelined frame
+	if (m_pFrameInFlight)
+		m_pWorkerPool->Wait();
+
+	delete m_pPresenter;
+	delete m_pWorkerPool;
+	delete m_pOcclusionCuller;
+	delete m_pDepthOnlyRasterizer;
+	for (FrameData& frame : m_Frames)
+	{
+		delete frame.pFrameBuffer;
+		delete frame.pShadowMap;
+	}
+	delete m_pDiffuseMap;
+	delete m_pNormalMap;
+	delete m_pGlossMap;
+	delete m_pSpecularMap;
+}
+
+void Renderer::Initialize()
+{
+	m_MillisecondsPerCount = 1000.0f / static_cast<float>(SDL_GetPerformanceFrequency());
+
+	//Create Buffers, the second frame is only needed once pipelining is enabled
+	InitFrame(m_Frames[0]);
+	m_pFrameBuffer = m_Frames[0].pFrameBuffer;
+	m_pBackBuffer = m_pFrameBuffer->GetSurface();
+
+	//The rendering thread works on tiles too, so one thread less
+	const int nrThreads{ std::max(static_cast<int>(std::thread::hardware_concurrency()) - 1, 0) };
+	m_pWorkerPool = new WorkerPool{ nrThreads };
+	m_WorkerStatistics.resize(m_pWorkerPool->GetNrWorkers());
+	m_RenderWidth = m_Width;
+	m_RenderHeight = m_Height;
+	m_TileGradients.resize(static_cast<size_t>((2 * m_Width + m_TileSize - 1) / m_TileSize) * ((2 * m_Height + m_TileSize - 1) / m_TileSize));
+
+	m_pOcclusionCuller = new OcclusionCuller{ m_Width, m_Height, m_OcclusionDownscale };
 
 	//Initialize Camera
 	m_Camera.Initialize(45.f, { .0f,.0f, 0.f }, static_cast<float>(m_Width) / m_Height);
@@ -42,298 +104,1210 @@ Renderer::Renderer(SDL_Window* pWindow) :
 
 }
 
-Renderer::~Renderer()
-{
-	delete[] m_pDepthBufferPixels;
-	delete m_pDiffuseMap;
-	delete m_pNormalMap;
-	delete m_pGlossMap;
-	delete m_pSpecularMap;
-}
-
 void Renderer::Update(Timer* pTimer)
 {
 	m_Camera.Update(pTimer);
 
+	if (m_UseDynamicResolution)
+		UpdateResolutionScale(pTimer->GetElapsed() * 1000.0f);
+
 	if (m_IsRotating)
 	{
 		const float meshRotationPerSecond{ 50.0f };
-		m_Mesh.worldMatrix = Matrix::CreateRotationY(meshRotationPerSecond * pTimer->GetElapsed() * TO_RADIANS) * m_Mesh.worldMatrix;
+		m_MeshYaw += meshRotationPerSecond * pTimer->GetElapsed();
+		UpdateMeshWorldMatrix();
 	}
 	
 }
 
-void Renderer::Render()
+void Renderer::SetCamera(const Vector3& origin, float pitch, float yaw)
 {
-	//@START
-	//Lock BackBuffer
-	SDL_LockSurface(m_pBackBuffer);
+	m_Camera.SetTransform(origin, pitch, yaw);
+}
+
+void Renderer::SetMeshYaw(float yaw)
+{
+	m_MeshYaw = yaw;
+	UpdateMeshWorldMatrix();
+}
+
+void Renderer::SetInstanceGrid(int nrColumns, int nrRows)
+{
+	//Far enough apart that the vehicles do not intersect while turning
+	const Vector3 spacing{ 40.f, 0.f, 36.f };
+
+	m_Instances.clear();
+	for (int row{}; row < nrRows; ++row)
+	{
+		for (int column{}; column < nrColumns; ++column)
+			m_Instances.push_back({ { (column - (nrColumns - 1) * 0.5f) * spacing.x, 0.f, row * spacing.z } });
+	}
+
+	UpdateMeshWorldMatrix();
+}
+
+void Renderer::UpdateMeshWorldMatrix()
+{
+	const Matrix rotation{ Matrix::CreateRotationY(m_MeshYaw * TO_RADIANS) };
+
+	m_Mesh.worldMatrix = rotation * Matrix::CreateTranslation(m_MeshPosition);
+	for (MeshInstance& instance : m_Instances)
+		instance.worldMatrix = rotation * Matrix::CreateTranslation(m_MeshPosition + instance.offset);
+
+	++m_ShadowMapVersion;
+}
+
+void Renderer::SetLightDirection(const Vector3& direction)
+{
+	m_LightDirection = direction.Normalized();
+	++m_ShadowMapVersion;
+}
+
+int Renderer::AddLight(const Light& light)
+{
+	m_Lights.push_back(light);
+	return static_cast<int>(m_Lights.size()) - 1;
+}
+
+void Renderer::ClearLights()
+{
+	m_Lights.clear();
+}
+
+void Renderer::ScatterLights(int nrLights)
+{
+	//Box around all instances, lights reach about half a mesh
+	Vector3 boundsMin{ FLT_MAX, FLT_MAX, FLT_MAX };
+	Vector3 boundsMax{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (const MeshInstance& instance : m_Instances)
+	{
+		const Vector3 instancePosition{ m_MeshPosition + instance.offset };
+		const Vector3 instanceMin{ instancePosition + m_MeshBoundsMin }, instanceMax{ instancePosition + m_MeshBoundsMax };
+		boundsMin = { std::min(boundsMin.x, instanceMin.x), std::min(boundsMin.y, instanceMin.y), std::min(boundsMin.z, instanceMin.z) };
+		boundsMax = { std::max(boundsMax.x, instanceMax.x), std::max(boundsMax.y, instanceMax.y), std::max(boundsMax.z, instanceMax.z) };
+	}
+
+	const Vector3 size{ boundsMax - boundsMin };
+	const Vector3 center{ (boundsMin + boundsMax) * 0.5f };
+	const float radius{ (m_MeshBoundsMax - m_MeshBoundsMin).Magnitude() * 0.35f };
 
-	//clear background
-	SDL_FillRect(m_pBackBuffer, NULL, SDL_MapRGB(m_pBackBuffer->format, 0, 0, 0));
+	m_Lights.clear();
+	for (int i{}; i < nrLights; ++i)
+	{
+		//Low discrepancy sequence, evenly spread without any randomness
+		const float u{ std::fmod(0.5f + i * 0.8191725f, 1.0f) };
+		const float v{ std::fmod(0.5f + i * 0.6710436f, 1.0f) };
+		const float w{ std::fmod(0.5f + i * 0.5497005f, 1.0f) };
+
+		Light light{};
+		light.position = { boundsMin.x + u * size.x, boundsMin.y + v * size.y * 1.5f, boundsMin.z + w * size.z };
+		light.color = { 0.5f + 0.5f * cosf(2 * PI * u), 0.5f + 0.5f * cosf(2 * PI * (u - 1.0f / 3)), 0.5f + 0.5f * cosf(2 * PI * (u - 2.0f / 3)) };
+		light.intensity = 2.0f;
+		light.radius = radius;
+
+		//Every fourth light is a spot aimed at the middle of the scene
+		if (i % 4 == 3)
+		{
+			light.type = LightType::Spot;
+			light.direction = (center - light.position).Normalized();
+			light.radius = radius * 2;
+		}
 
-	//reset buffer
-	const int nrPixels{ m_Width * m_Height };
-	std::fill_n(m_pDepthBufferPixels, nrPixels, FLT_MAX);
+		m_Lights.push_back(light);
+	}
+}
 
-	//Rasterization
-	VertexTransformationFunction();
+void Renderer::Render()
+{
+	const uint64_t frameStart{ SDL_GetPerformanceCounter() };
+	uint64_t stageStart{ frameStart };
+	m_StageTimings.postProcess = 0.f;
+
+	//Stage timings share their timestamps with the profiler markers
+	const auto endStage = [&](float& stageTime, const char* stageName)
+	{
+		const uint64_t stageEnd{ SDL_GetPerformanceCounter() };
+		stageTime = (stageEnd - stageStart) * m_MillisecondsPerCount;
+		PROFILE_EVENT(stageName, stageStart, stageEnd);
+		stageStart = stageEnd;
+	};
+
+	//With pipelining or the present thread the frames rotate, the others can still be in flight or resolving
+	FrameData& frame{ m_Frames[m_NextFrame] };
+	if (GetNrFrames() > 1)
+		m_NextFrame = (m_NextFrame + 1) % GetNrFrames();
+
+	//Only right after the frame count changed, otherwise the present thread resolves another framebuffer
+	if (m_pPresenter)
+		m_pPresenter->WaitForResolve(frame.pFrameBuffer);
+
+	frame.renderMode = m_CurrentRenderMode;
+	frame.colorMode = m_CurrentColorMode;
+	frame.useNormalMap = m_UseNormalMap;
+	frame.useLazyClear = m_UseLazyClear;
+	frame.isReversedZ = m_Camera.isReversedZ;
+	frame.useHiZ = m_UseHiZ;
+	frame.useShadows = m_UseShadows;
+	frame.useFastSpecular = m_UseFastSpecular;
+	frame.shadingRatePolicy = m_ShadingRatePolicy;
+	frame.tileKernel = SelectTileKernel(frame.renderMode, frame.colorMode, frame.useNormalMap);
+
+	//The frame is not in flight, so its planes and tiles can be reallocated for the other sample count
+	const int nrSamples{ m_UseMsaa ? 4 : 1 };
+	if (frame.pFrameBuffer->GetSampleCount() != nrSamples)
+	{
+		frame.pFrameBuffer->SetSampleCount(nrSamples);
+		InitTiles(frame);
+	}
+	frame.samplesPerSide = frame.pFrameBuffer->GetSamplesPerSide();
+	frame.useFxaa = m_UseFxaa && frame.samplesPerSide == 1;
+	frame.pFrameBuffer->SetFxaa(frame.useFxaa);
+
+	//Rendered into the top left of the framebuffer, the tiles past it stay empty
+	frame.width = m_RenderWidth * frame.samplesPerSide;
+	frame.height = m_RenderHeight * frame.samplesPerSide;
+	frame.pFrameBuffer->SetRenderSize(m_RenderWidth, m_RenderHeight);
+	for (Tile& tile : frame.tiles)
+	{
+		tile.x1 = std::min(tile.x0 + m_TileSize, frame.width);
+		tile.y1 = std::min(tile.y0 + m_TileSize, frame.height);
+	}
+	frame.pFrameBuffer->SetDepthFormat(m_DepthFormat);
+	frame.pFrameBuffer->SetDepthCompression(m_UseDepthCompression);
+	frame.depthClearValue = frame.isReversedZ ? 0.0f : FLT_MAX;
+	frame.pFrameBuffer->SetDepthClearValue(frame.depthClearValue);
 
-	std::vector<Vector2> screenVertices{};
+	frame.sceneKey = CalculateSceneKey(frame);
+	frame.instancesKey = HashValue(m_Instances.size());
+	for (const MeshInstance& instance : m_Instances)
+		frame.instancesKey = HashValue(instance.worldMatrix, frame.instancesKey);
 
-	screenVertices.reserve(m_Mesh.vertices_out.size());
-	for (auto& vertex : m_Mesh.vertices_out)
+	//@START
+	//clear background + reset depth buffer in one pass, otherwise done per tile during rasterization
+	frame.statistics = PipelineStatistics{};
+	if (!frame.useLazyClear)
 	{
-		screenVertices.push_back({
-			(vertex.position.x + 1) * 0.5f * m_Width,
-			(1.0f - vertex.position.y) * 0.5f * m_Height
-			});
+		frame.pFrameBuffer->Clear(colors::Black, frame.depthClearValue);
+		if (!m_UseDepthCompression)
+			frame.statistics.depthBytes += static_cast<uint64_t>(frame.pFrameBuffer->GetSampleWidth()) * frame.pFrameBuffer->GetSampleHeight() * frame.pFrameBuffer->GetDepthBytesPerPixel();
 	}
 
-	//RENDER LOGIC
+	endStage(m_StageTimings.clear, "Clear");
 
+	//Nothing changed since this framebuffer was last rendered, its vertices, triangles and tiles are still valid
+	const bool isUnchanged{ m_UseIncrementalRendering && frame.useLazyClear &&
+		frame.sceneKey == frame.renderedSceneKey && frame.instancesKey == frame.renderedInstancesKey };
+	frame.renderedSceneKey = frame.sceneKey;
+	frame.renderedInstancesKey = frame.instancesKey;
 
-	switch (m_Mesh.primitiveTopology)
+	if (isUnchanged)
+	{
+		m_StageTimings.shadowMap = 0.f;
+		m_StageTimings.occlusionCulling = 0.f;
+		m_StageTimings.lightCulling = 0.f;
+		m_StageTimings.vertexTransform = 0.f;
+		m_StageTimings.projection = 0.f;
+		m_StageTimings.binning = 0.f;
+	}
+	else
 	{
-	case PrimitiveTopology::TriangleList:
+		if (frame.useShadows && UpdateShadowMap(frame))
+			endStage(m_StageTimings.shadowMap, "ShadowMap");
+		else
+			m_StageTimings.shadowMap = 0.f;
+
+		CullInstances(frame);
+
+		endStage(m_StageTimings.occlusionCulling, "OcclusionCulling");
+
+		CullLights(frame);
 
-		for (int i{}; i < m_Mesh.indices.size(); i += 3)
+		endStage(m_StageTimings.lightCulling, "LightCulling");
+
+		//Rasterization
+		VertexTransformationFunction(frame);
+
+		endStage(m_StageTimings.vertexTransform, "VertexTransform");
+
+		//The samples of a pixel lie around its center, a quarter pixel away on both axes with MSAA
+		const float sampleOffset{ (frame.samplesPerSide - 1) * 0.5f };
+		frame.screenVertices.clear();
+		frame.screenVertices.reserve(frame.vertices.size());
+		for (auto& vertex : frame.vertices)
 		{
-			int index0{ i }, index1{ i + 1 }, index2{ i + 2 };
+			frame.screenVertices.push_back({
+				(vertex.position.x + 1) * 0.5f * frame.width + sampleOffset,
+				(1.0f - vertex.position.y) * 0.5f * frame.height + sampleOffset
+				});
+		}
 
-			RenderTraingle(index0, index1, index2, screenVertices);
+		endStage(m_StageTimings.projection, "Projection");
 
+		//RENDER LOGIC
+		//Sort the triangles into the tiles they overlap
+		frame.triangles.clear();
+		for (Tile& tile : frame.tiles)
+		{
+			tile.triangles.clear();
+			tile.instancesKey = HashValue(0);
+			tile.lastInstanceKey = 0;
 		}
-		break;
-	case PrimitiveTopology::TriangleStrip:
 
-		for (int i{}; i < m_Mesh.indices.size() - 2; ++i)
+		//Every visible instance added a full copy of the mesh vertices
+		const std::vector<uint32_t>& indices{ m_Mesh.indices };
+		for (int instance{}; instance < static_cast<int>(m_VisibleInstances.size()); ++instance)
 		{
+			const int vertexOffset{ instance * static_cast<int>(m_Mesh.vertices.size()) };
+			const uint64_t instanceKey{ HashValue(m_Instances[m_VisibleInstances[instance]].worldMatrix, HashValue(m_VisibleInstances[instance])) };
+
+			switch (m_Mesh.primitiveTopology)
+			{
+			case PrimitiveTopology::TriangleList:
 
-			int index0{ i }, index1{}, index2{};
-			// if n&1 is 1, then odd, else even
+				for (int i{}; i < indices.size(); i += 3)
+				{
+					int index0{ i }, index1{ i + 1 }, index2{ i + 2 };
+
+					BinTriangle(frame, vertexOffset + indices[index0], vertexOffset + indices[index1], vertexOffset + indices[index2], instanceKey);
+
+				}
+				break;
+			case PrimitiveTopology::TriangleStrip:
+
+				for (int i{}; i < indices.size() - 2; ++i)
+				{
+
+					int index0{ i }, index1{}, index2{};
+					// if n&1 is 1, then odd, else even
 
-			bool swapIndeces = i % 2;
+					bool swapIndeces = i % 2;
 
 
-			index1 = i + !swapIndeces * 1 + swapIndeces * 2;
-			index2 = i + !swapIndeces * 2 + swapIndeces * 1;
+					index1 = i + !swapIndeces * 1 + swapIndeces * 2;
+					index2 = i + !swapIndeces * 2 + swapIndeces * 1;
 
-			RenderTraingle(index0, index1, index2, screenVertices);
+					BinTriangle(frame, vertexOffset + indices[index0], vertexOffset + indices[index1], vertexOffset + indices[index2], instanceKey);
+				}
+				break;
+			}
 		}
-		break;
+
+		endStage(m_StageTimings.binning, "Binning");
 	}
 
+	//The previous frame was rasterized in the background while this one went through the vertex stage
+	FrameData* pPreviousFrame{ m_pFrameInFlight };
+	if (pPreviousFrame)
+		FinishRasterization(*pPreviousFrame);
+
+	//No worker writes the gradients anymore. They are outdated when the last frame did not write them or its tiles were laid out differently
+	const bool writesTileGradients{ frame.renderMode == RenderMode::Texture && frame.shadingRatePolicy == ShadingRatePolicy::Adaptive };
+	if (writesTileGradients && (!m_AreTileGradientsWritten || m_TileGradientsSamplesPerSide != frame.samplesPerSide))
+		std::fill(m_TileGradients.begin(), m_TileGradients.end(), TileGradient{});
+	m_AreTileGradientsWritten = writesTileGradients;
+	m_TileGradientsSamplesPerSide = frame.samplesPerSide;
+
+	SelectShadingRates(frame);
+	UpdateTileKeys(frame);
+	StartRasterization(frame);
+
+	FrameData* pPresentFrame{ pPreviousFrame };
+	m_pFrameInFlight = &frame;
+	if (m_FrameLatency == 0)
+	{
+		FinishRasterization(frame);
+		m_pFrameInFlight = nullptr;
+		pPresentFrame = &frame;
+	}
 
+	endStage(m_StageTimings.rasterization, "Rasterization + Shading");
 
 	//@END
-	//Update SDL Surface
-	SDL_UnlockSurface(m_pBackBuffer);
-	SDL_BlitSurface(m_pBackBuffer, 0, m_pFrontBuffer, 0);
-	SDL_UpdateWindowSurface(m_pWindow);
+	//Presenting the previous frame overlaps with the rasterization of this one
+	m_StageTimings.resolve = 0.f;
+	m_StageTimings.blit = 0.f;
+	m_StageTimings.present = 0.f;
+	if (pPresentFrame)
+	{
+		m_pFrameBuffer = pPresentFrame->pFrameBuffer;
+		m_pBackBuffer = m_pFrameBuffer->GetSurface();
+		m_Statistics = pPresentFrame->statistics;
+
+		if (m_pPresenter)
+		{
+			//The window shows the frame the present thread resolved while this one rendered, this one is resolved while the next renders
+			if (m_pPresenter->Present())
+				endStage(m_StageTimings.blit, "Blit");
+
+			m_pPresenter->Submit(m_pFrameBuffer);
+		}
+		else
+		{
+			//Float color buffer => packed pixels, written straight into the window surface when possible
+			const bool presentDirectly{ IsPresentingDirectly() };
+			if (presentDirectly)
+			{
+				SDL_LockSurface(m_pFrontBuffer);
+				m_pFrameBuffer->Resolve(static_cast<uint32_t*>(m_pFrontBuffer->pixels), m_pFrontBuffer->pitch, m_FrontBufferFormat);
+				SDL_UnlockSurface(m_pFrontBuffer);
+			}
+			else
+			{
+				SDL_LockSurface(m_pBackBuffer);
+				m_pFrameBuffer->Resolve();
+				SDL_UnlockSurface(m_pBackBuffer);
+			}
+
+			endStage(m_StageTimings.resolve, "Resolve");
+
+			//Presentation is optional, headless renderers only fill the framebuffer
+			if (!IsHeadless())
+			{
+				//Fallback, the BackBuffer has to be copied (and converted) to the window surface
+				if (!presentDirectly)
+				{
+					SDL_BlitSurface(m_pBackBuffer, 0, m_pFrontBuffer, 0);
+					endStage(m_StageTimings.blit, "Blit");
+				}
+
+				SDL_UpdateWindowSurface(m_pWindow);
+			}
+		}
+
+		endStage(m_StageTimings.present, "Present");
+	}
+
+	m_StageTimings.total = (stageStart - frameStart) * m_MillisecondsPerCount;
+	PROFILE_EVENT("Frame", frameStart, stageStart);
 }
 
+int Renderer::RenderDepthOnly()
+{
+	//Only allocated when used
+	if (!m_pDepthOnlyRasterizer)
+		m_pDepthOnlyRasterizer = new DepthRasterizer{ m_Width, m_Height };
+
+	m_pDepthOnlyRasterizer->Clear(m_Camera.isReversedZ);
+
+	if (m_Mesh.primitiveTopology != PrimitiveTopology::TriangleList)
+		return 0;
+
+	const Matrix viewProjectionMatrix{ m_Camera.viewMatrix * m_Camera.projectionMatrix };
 
-void Renderer::VertexTransformationFunction()
+	int nrTriangles{};
+	for (const MeshInstance& instance : m_Instances)
+		nrTriangles += m_pDepthOnlyRasterizer->RasterizeTriangles(instance.worldMatrix * viewProjectionMatrix, m_MeshPositions, m_Mesh.indices);
+
+	return nrTriangles;
+}
+
+void Renderer::StartRasterization(FrameData& frame)
 {
-	m_Mesh.vertices_out.clear();
-	m_Mesh.vertices_out.reserve(m_Mesh.vertices.size());
+	//Every tile only touches its own pixels, so tiles are rasterized in parallel
+	for (PipelineStatistics& workerStatistics : m_WorkerStatistics)
+		workerStatistics = PipelineStatistics{};
 
-	Matrix worldViewProjectionMatrix{ m_Mesh.worldMatrix * m_Camera.viewMatrix * m_Camera.projectionMatrix };
+	m_pWorkerPool->Dispatch(static_cast<int>(frame.tiles.size()), [this, &frame](int tileIndex, int workerIndex)
+		{
+			(this->*frame.tileKernel)(frame, frame.tiles[tileIndex], m_WorkerStatistics[workerIndex]);
+		});
+}
 
-	for (const Vertex& vertex : m_Mesh.vertices)
+void Renderer::FinishRasterization(FrameData& frame)
+{
+	m_pWorkerPool->Wait();
+
+	for (const PipelineStatistics& workerStatistics : m_WorkerStatistics)
+	{
+		frame.statistics.boundingBoxPixelsTested += workerStatistics.boundingBoxPixelsTested;
+		frame.statistics.pixelsCovered += workerStatistics.pixelsCovered;
+		frame.statistics.depthTestsPassed += workerStatistics.depthTestsPassed;
+		frame.statistics.depthTestsFailed += workerStatistics.depthTestsFailed;
+		frame.statistics.shaderInvocations += workerStatistics.shaderInvocations;
+		frame.statistics.helperPixels += workerStatistics.helperPixels;
+		frame.statistics.hiZTrianglesRejected += workerStatistics.hiZTrianglesRejected;
+		frame.statistics.hiZBlocksRejected += workerStatistics.hiZBlocksRejected;
+		frame.statistics.hiZPixelTestsAvoided += workerStatistics.hiZPixelTestsAvoided;
+		frame.statistics.depthBytes += workerStatistics.depthBytes;
+		frame.statistics.lightEvaluations += workerStatistics.lightEvaluations;
+	}
+
+	frame.statistics.overdraw = static_cast<float>(frame.statistics.depthTestsPassed) / (frame.width * frame.height);
+
+	if (frame.useFxaa)
+		ApplyFxaa(frame);
+}
+
+void Renderer::ApplyFxaa(FrameData& frame)
+{
+	const uint64_t start{ SDL_GetPerformanceCounter() };
+
+	//The search along an edge stays within 20 pixels, so only the 8 neighbouring tiles can change a tile's result
+	const int nrTiles{ static_cast<int>(frame.tiles.size()) };
+	const int nrTilesY{ nrTiles / frame.nrTilesX };
+	const auto isFiltered = [&frame, nrTilesY](int tileIndex)
 	{
-		Vertex_Out vertexOut{ {}, vertex.color, vertex.uv, vertex.normal, vertex.normal };
-		vertexOut.position = worldViewProjectionMatrix.TransformPoint({ vertex.position, 1.0f });
+		const int tileX{ tileIndex % frame.nrTilesX };
+		const int tileY{ tileIndex / frame.nrTilesX };
+		for (int y{ std::max(tileY - 1, 0) }; y <= std::min(tileY + 1, nrTilesY - 1); ++y)
+		{
+			for (int x{ std::max(tileX - 1, 0) }; x <= std::min(tileX + 1, frame.nrTilesX - 1); ++x)
+			{
+				if (!frame.tiles[x + y * frame.nrTilesX].isUnchanged)
+					return true;
+			}
+		}
+		return false;
+	};
 
+	//The lumas of kept tiles are still in the framebuffer, every other tile needs its lumas before any tile is filtered
+	m_pWorkerPool->Run(nrTiles, [&frame](int tileIndex, int)
+		{
+			const Tile& tile{ frame.tiles[tileIndex] };
+			if (tile.x0 < tile.x1 && tile.y0 < tile.y1 && !tile.isUnchanged)
+				frame.pFrameBuffer->CalculateFxaaLuma(tile.x0, tile.y0, tile.x1, tile.y1);
+		});
 
-		vertexOut.viewDirection = Vector3{ vertexOut.position.x, vertexOut.position.y, vertexOut.position.z }.Normalized();
+	m_pWorkerPool->Run(nrTiles, [&frame, &isFiltered](int tileIndex, int)
+		{
+			const Tile& tile{ frame.tiles[tileIndex] };
+			if (tile.x0 < tile.x1 && tile.y0 < tile.y1 && isFiltered(tileIndex))
+				frame.pFrameBuffer->ApplyFxaa(tile.x0, tile.y0, tile.x1, tile.y1);
+		});
+
+	const uint64_t end{ SDL_GetPerformanceCounter() };
+	m_StageTimings.postProcess = (end - start) * m_MillisecondsPerCount;
+	PROFILE_EVENT("FXAA", start, end);
+}
+
+void Renderer::SelectShadingRates(FrameData& frame)
+{
+	for (int tileIndex{}; tileIndex < static_cast<int>(frame.tiles.size()); ++tileIndex)
+	{
+		Tile& tile{ frame.tiles[tileIndex] };
 
-		vertexOut.normal = m_Mesh.worldMatrix.TransformVector(vertex.normal);
-		vertexOut.tangent = m_Mesh.worldMatrix.TransformVector(vertex.tangent);
+		//In pixels here, scaled to samples below
+		switch (frame.renderMode == RenderMode::Texture ? frame.shadingRatePolicy : ShadingRatePolicy::Full)
+		{
+		case ShadingRatePolicy::Half:
+			tile.shadingRate = 2;
+			break;
+		case ShadingRatePolicy::Quarter:
+			tile.shadingRate = 4;
+			break;
+		case ShadingRatePolicy::Adaptive:
+		{
+			//Tiles that were empty last frame start at full rate when geometry moves in
+			//Coarse samples sit at the center of their block instead of on the measured pixels, so a tile keeps its rate up to a bit more detail than it takes to get there
+			constexpr float keepRateFactor{ 1.25f };
+			const TileGradient& gradient{ m_TileGradients[tileIndex] };
+			const float quarterRateGradient{ gradient.shadingRate >= 4 ? m_QuarterRateGradient * keepRateFactor : m_QuarterRateGradient };
+			const float halfRateGradient{ gradient.shadingRate >= 2 ? m_HalfRateGradient * keepRateFactor : m_HalfRateGradient };
+			tile.shadingRate = gradient.quarterRate < quarterRateGradient ? 4 : gradient.halfRate < halfRateGradient ? 2 : 1;
+			break;
+		}
+		default:
+			tile.shadingRate = 1;
+			break;
+		}
 
+		//Shading quads can not be larger than a depth block, so MSAA shades 4x4 rate tiles at 2x2
+		if (frame.renderMode == RenderMode::Texture)
+			tile.shadingRate = std::min(tile.shadingRate * frame.samplesPerSide, FrameBuffer::CoarseBlockSize / 2);
 
-		vertexOut.position.x /= vertexOut.position.w;
-		vertexOut.position.y /= vertexOut.position.w;
-		vertexOut.position.z /= vertexOut.position.w;
+		if (tile.triangles.empty())
+			continue;
 
-		m_Mesh.vertices_out.emplace_back(vertexOut);
+		const int pixelShadingRate{ tile.shadingRate / frame.samplesPerSide };
+		if (pixelShadingRate == 2)
+			++frame.statistics.halfRateTiles;
+		else if (pixelShadingRate == 4)
+			++frame.statistics.quarterRateTiles;
 	}
+}
+
+uint64_t Renderer::CalculateSceneKey(const FrameData& frame) const
+{
+	//Settings that can not change the image, like HiZ or the frame latency, are left out
+	uint64_t key{ HashValue(m_Camera.viewMatrix) };
+	key = HashValue(m_Camera.projectionMatrix, key);
+	key = HashValue(frame.renderMode, key);
+	key = HashValue(frame.colorMode, key);
+	key = HashValue(frame.useNormalMap, key);
+	key = HashValue(frame.useShadows, key);
+	key = HashValue(frame.useFastSpecular, key);
+	key = HashValue(frame.isReversedZ, key);
+	key = HashValue(m_DepthFormat, key);
+	key = HashValue(m_UseDepthCompression, key);
+	key = HashValue(frame.shadingRatePolicy, key);
+	key = HashValue(frame.samplesPerSide, key);
+	key = HashValue(frame.useFxaa, key);
+	key = HashValue(frame.width, key);
+	key = HashValue(frame.height, key);
+	key = HashValue(m_LightDirection, key);
+	return HashBytes(m_Lights.data(), m_Lights.size() * sizeof(Light), key);
+}
+
+void Renderer::UpdateTileKeys(FrameData& frame)
+{
+	//Empty tiles only hold the clear values, and need their lumas when FXAA was just enabled
+	const uint64_t clearedKey{ HashValue(frame.useFxaa, HashValue(frame.isReversedZ, HashValue(m_DepthFormat, HashValue(m_UseDepthCompression)))) };
+	//Every instance casts shadows onto every tile
+	const uint64_t shadedKey{ HashValue(frame.useShadows ? frame.instancesKey : 0, frame.sceneKey) };
 
+	for (Tile& tile : frame.tiles)
+	{
+		uint64_t key{ tile.triangles.empty() ? clearedKey : HashValue(tile.shadingRate, HashValue(tile.instancesKey, shadedKey)) };
+		key = HashValue(tile.x1, HashValue(tile.y1, key));
+
+		//Without lazy clears the whole framebuffer was just cleared
+		tile.isUnchanged = m_UseIncrementalRendering && frame.useLazyClear && key == tile.renderedKey;
+		tile.renderedKey = key;
+
+		if (tile.isUnchanged && tile.x0 < tile.x1 && tile.y0 < tile.y1)
+			++frame.statistics.tilesUnchanged;
+	}
 }
 
-void Renderer::RenderTraingle(int i0, int i1, int i2, std::vector<Vector2>& screenVertices)
+void Renderer::CullInstances(FrameData& frame)
 {
+	m_VisibleInstances.clear();
+	frame.statistics.instancesSubmitted += m_Instances.size();
 
-	if (PositionOutsideFrustrum(m_Mesh.vertices_out[m_Mesh.indices[i0]].position) ||
-		PositionOutsideFrustrum(m_Mesh.vertices_out[m_Mesh.indices[i1]].position) ||
-		PositionOutsideFrustrum(m_Mesh.vertices_out[m_Mesh.indices[i2]].position))
+	if (!m_UseOcclusionCulling)
+	{
+		for (int instance{}; instance < static_cast<int>(m_Instances.size()); ++instance)
+			m_VisibleInstances.push_back(instance);
 		return;
+	}
 
-	const Vector2& v0{ screenVertices[m_Mesh.indices[i0]] };
-	const Vector2& v1{ screenVertices[m_Mesh.indices[i1]] };
-	const Vector2& v2{ screenVertices[m_Mesh.indices[i2]] };
+	//Front to back, so the closest instances occlude the ones behind them
+	m_SortedInstances.clear();
+	for (int instance{}; instance < static_cast<int>(m_Instances.size()); ++instance)
+		m_SortedInstances.push_back({ (m_Instances[instance].worldMatrix.GetTranslation() - m_Camera.origin).SqrMagnitude(), instance });
+	std::sort(m_SortedInstances.begin(), m_SortedInstances.end());
 
-	const Vector2 edge0{ v1 - v0 };
-	const Vector2 edge1{ v2 - v1 };
-	const Vector2 edge2{ v0 - v2 };
+	m_pOcclusionCuller->Clear(frame.isReversedZ);
 
-	const float triangleArea{ Vector2::Cross(edge0, edge1) };
+	const Matrix viewProjectionMatrix{ m_Camera.viewMatrix * m_Camera.projectionMatrix };
+	for (size_t i{}; i < m_SortedInstances.size(); ++i)
+	{
+		const int instance{ m_SortedInstances[i].second };
+		const Matrix worldViewProjectionMatrix{ m_Instances[instance].worldMatrix * viewProjectionMatrix };
 
+		switch (m_pOcclusionCuller->TestBounds(worldViewProjectionMatrix, m_MeshBoundsMin, m_MeshBoundsMax))
+		{
+		case OcclusionCuller::Visibility::OutsideFrustum:
+			++frame.statistics.instancesFrustumCulled;
+			continue;
+		case OcclusionCuller::Visibility::Occluded:
+			++frame.statistics.instancesOccluded;
+			continue;
+		default:
+			break;
+		}
 
-	const Vector2 minBB{ Vector2::Min(v0, Vector2::Min(v1, v2)) };
-	const Vector2 maxBB{ Vector2::Max(v0, Vector2::Max(v1, v2)) };
+		m_VisibleInstances.push_back(instance);
+
+		//Nothing is tested against the last one, strips are not rasterized as occluders
+		if (i + 1 < m_SortedInstances.size() && m_Mesh.primitiveTopology == PrimitiveTopology::TriangleList)
+			frame.statistics.occluderTriangles += m_pOcclusionCuller->RasterizeOccluder(worldViewProjectionMatrix, m_MeshPositions, m_Mesh.indices);
+	}
+}
 
+bool Renderer::UpdateShadowMap(FrameData& frame)
+{
+	if (frame.pShadowMap && frame.shadowMapVersion == m_ShadowMapVersion)
+		return false;
 
-	const int startX{ std::clamp(static_cast<int>(minBB.x) - 1, 0, m_Width) };
-	const int startY{ std::clamp(static_cast<int>(minBB.y) - 1, 0, m_Height) };
-	const int endX{ std::clamp(static_cast<int>(maxBB.x) + 1, 0, m_Width) };
-	const int endY{ std::clamp(static_cast<int>(maxBB.y) + 1, 0, m_Height) };
+	//Only allocated when used
+	if (!frame.pShadowMap)
+		frame.pShadowMap = new DepthRasterizer{ m_ShadowMapSize, m_ShadowMapSize };
+	frame.shadowMapVersion = m_ShadowMapVersion;
 
+	//Box around the bounding spheres of the instances, their own boxes turn with them
+	const Vector3 meshCenter{ (m_MeshBoundsMin + m_MeshBoundsMax) * 0.5f };
+	const float meshRadius{ (m_MeshBoundsMax - m_MeshBoundsMin).Magnitude() * 0.5f };
 
-	for (int px{ startX }; px < endX; ++px)
+	Vector3 sceneMin{ FLT_MAX, FLT_MAX, FLT_MAX };
+	Vector3 sceneMax{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (const MeshInstance& instance : m_Instances)
 	{
-		for (int py{ startY }; py < endY; ++py)
-		{
-			const int pixelIndex{ px + py * m_Width };
-			Vector2 currentPixel{ static_cast<float>(px), static_cast<float>(py) };
-
-			if (currentPixel.x < minBB.x || currentPixel.x > maxBB.x ||
-				currentPixel.y < minBB.y || currentPixel.y > maxBB.y) continue;
+		const Vector3 center{ instance.worldMatrix.TransformPoint(meshCenter) };
+		sceneMin = { std::min(sceneMin.x, center.x - meshRadius), std::min(sceneMin.y, center.y - meshRadius), std::min(sceneMin.z, center.z - meshRadius) };
+		sceneMax = { std::max(sceneMax.x, center.x + meshRadius), std::max(sceneMax.y, center.y + meshRadius), std::max(sceneMax.z, center.z + meshRadius) };
+	}
 
-			const Vector2 v0ToPixel{ currentPixel - v0 };
-			const Vector2 v1ToPixel{ currentPixel - v1 };
-			const Vector2 v2ToPixel{ currentPixel - v2 };
+	const Vector3 sceneCenter{ (sceneMin + sceneMax) * 0.5f };
+	const float sceneRadius{ (sceneMax - sceneMin).Magnitude() * 0.5f };
 
-			const float edge0PixelCross{ Vector2::Cross(edge0, v0ToPixel) };
-			const float edge1PixelCross{ Vector2::Cross(edge1, v1ToPixel) };
-			const float edge2PixelCross{ Vector2::Cross(edge2, v2ToPixel) };
+	//Orthographic projection along the light that just fits the scene, depth is linear over its diameter
+	const Vector3 worldUp{ std::abs(m_LightDirection.y) > 0.99f ? Vector3::UnitZ : Vector3::UnitY };
+	const Matrix lightViewMatrix{ Matrix::CreateLookAtLH(sceneCenter - m_LightDirection * sceneRadius, m_LightDirection, worldUp) };
+	frame.shadowMatrix = lightViewMatrix * Matrix::CreateOrthographicLH(2 * sceneRadius, 2 * sceneRadius, 0.f, 2 * sceneRadius);
 
+	frame.pShadowMap->Clear(false);
 
-			if (!(edge0PixelCross > 0 && edge1PixelCross > 0 && edge2PixelCross > 0)) continue;
+	//Every instance casts a shadow, also the ones that are culled from the camera's view
+	if (m_Mesh.primitiveTopology == PrimitiveTopology::TriangleList)
+	{
+		for (const MeshInstance& instance : m_Instances)
+			frame.statistics.shadowMapTriangles += frame.pShadowMap->RasterizeTriangles(instance.worldMatrix * frame.shadowMatrix, m_MeshPositions, m_Mesh.indices);
+	}
 
+	return true;
+}
 
-			const float weightV0{ edge1PixelCross / triangleArea };
-			const float weightV1{ edge2PixelCross / triangleArea };
-			const float weightV2{ edge0PixelCross / triangleArea };
+void Renderer::CullLights(FrameData& frame)
+{
+	frame.lights.clear();
+	for (Tile& tile : frame.tiles)
+		tile.lights.clear();
+
+	frame.statistics.lightsSubmitted = m_Lights.size();
+
+	//The tile grid covers the whole framebuffer, only the tiles of the render size are used
+	const int nrTilesX{ frame.nrTilesX };
+	const float sampleOffset{ (frame.samplesPerSide - 1) * 0.5f };
+	const int nrRenderTilesX{ (frame.width + m_TileSize - 1) / m_TileSize };
+	const int nrRenderTilesY{ (frame.height + m_TileSize - 1) / m_TileSize };
+	//View space => NDC, before the divide by depth
+	const float scaleX{ 1.0f / (m_Camera.fov * m_Camera.aspectRatio) };
+	const float scaleY{ 1.0f / m_Camera.fov };
+
+	for (const Light& light : m_Lights)
+	{
+		const float radius{ light.radius };
 
+		//Without culling every light is shaded in every tile, it only fades to zero past its radius
+		int startTileX{ 0 }, endTileX{ nrRenderTilesX - 1 }, startTileY{ 0 }, endTileY{ nrRenderTilesY - 1 };
+		if (m_UseLightCulling)
+		{
+			const Vector3 viewPosition{ m_Camera.viewMatrix.TransformPoint(light.position) };
 
-			const float interpolatedZDepth
+			//Spot lights are culled by their whole sphere as well, the cone only matters in the shading loop
+			if (viewPosition.z + radius <= m_Camera.near || viewPosition.z - radius >= m_Camera.far)
 			{
-				1.0f /
-					(weightV0 / m_Mesh.vertices_out[m_Mesh.indices[i0]].position.z +
-					weightV1 / m_Mesh.vertices_out[m_Mesh.indices[i1]].position.z +
-					weightV2 / m_Mesh.vertices_out[m_Mesh.indices[i2]].position.z)
-			};
+				++frame.statistics.lightsCulled;
+				continue;
+			}
 
+			//Projection of the box around the sphere, a sphere reaching past the near plane can cover the whole screen
+			float minX{ -1.0f }, maxX{ 1.0f }, minY{ -1.0f }, maxY{ 1.0f };
+			if (viewPosition.z - radius > m_Camera.near)
+			{
+				const float nearZ{ viewPosition.z - radius }, farZ{ viewPosition.z + radius };
+				minX = std::min((viewPosition.x - radius) / nearZ, (viewPosition.x - radius) / farZ) * scaleX;
+				maxX = std::max((viewPosition.x + radius) / nearZ, (viewPosition.x + radius) / farZ) * scaleX;
+				minY = std::min((viewPosition.y - radius) / nearZ, (viewPosition.y - radius) / farZ) * scaleY;
+				maxY = std::max((viewPosition.y + radius) / nearZ, (viewPosition.y + radius) / farZ) * scaleY;
+			}
 
-			if (interpolatedZDepth < 0.0f || interpolatedZDepth > 1.0f ||
-				m_pDepthBufferPixels[pixelIndex] < interpolatedZDepth)
+			if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f)
+			{
+				++frame.statistics.lightsCulled;
 				continue;
+			}
 
-			m_pDepthBufferPixels[pixelIndex] = interpolatedZDepth;
+			startTileX = static_cast<int>((std::max(minX, -1.0f) + 1) * 0.5f * frame.width + sampleOffset) / m_TileSize;
+			endTileX = std::min(static_cast<int>((std::min(maxX, 1.0f) + 1) * 0.5f * frame.width + sampleOffset) / m_TileSize, nrRenderTilesX - 1);
+			startTileY = static_cast<int>((1.0f - std::min(maxY, 1.0f)) * 0.5f * frame.height + sampleOffset) / m_TileSize;
+			endTileY = std::min(static_cast<int>((1.0f - std::max(minY, -1.0f)) * 0.5f * frame.height + sampleOffset) / m_TileSize, nrRenderTilesY - 1);
+		}
 
+		const uint32_t lightIndex{ static_cast<uint32_t>(frame.lights.size()) };
+		const float cosInnerCone{ cosf(light.innerConeAngle * TO_RADIANS) };
+		const float cosOuterCone{ cosf(light.outerConeAngle * TO_RADIANS) };
+		frame.lights.push_back({
+			light.position,
+			-light.direction.Normalized(),
+			light.color,
+			light.intensity,
+			1.0f / (radius * radius),
+			light.type == LightType::Spot,
+			cosOuterCone,
+			1.0f / std::max(cosInnerCone - cosOuterCone, 1e-4f) });
+
+		for (int tileY{ startTileY }; tileY <= endTileY; ++tileY)
+		{
+			for (int tileX{ startTileX }; tileX <= endTileX; ++tileX)
+				frame.tiles[tileX + tileY * nrTilesX].lights.push_back(lightIndex);
+		}
 
-			switch (m_CurrentRenderMode)
-			{
-			case dae::Renderer::RenderMode::Texture:
-			{
+		frame.statistics.lightTileEntries += static_cast<uint64_t>(endTileX - startTileX + 1) * (endTileY - startTileY + 1);
+	}
+}
 
-				const Vertex_Out& v0 = m_Mesh.vertices_out[m_Mesh.indices[i0]];
-				const Vertex_Out& v1 = m_Mesh.vertices_out[m_Mesh.indices[i1]];
-				const Vertex_Out& v2 = m_Mesh.vertices_out[m_Mesh.indices[i2]];
+void Renderer::VertexTransformationFunction(FrameData& frame)
+{
+	frame.vertices.clear();
+	frame.vertices.reserve(m_Mesh.vertices.size() * m_VisibleInstances.size());
 
-				Vertex_Out interpolatedVertex{};
+	for (int instance : m_VisibleInstances)
+	{
+		const Matrix& worldMatrix{ m_Instances[instance].worldMatrix };
+		Matrix worldViewProjectionMatrix{ worldMatrix * m_Camera.viewMatrix * m_Camera.projectionMatrix };
+		const Matrix worldShadowMatrix{ worldMatrix * frame.shadowMatrix };
 
-				const float interpolatedWWeight
-				{
-					1.0f / (
-						weightV0 / v0.position.w +
-						weightV1 / v1.position.w +
-						weightV2 / v2.position.w
-						)
-				};
+		frame.statistics.inputVertices += m_Mesh.vertices.size();
 
-				// uv
+		for (const Vertex& vertex : m_Mesh.vertices)
+		{
+			Vertex_Out vertexOut{ {}, vertex.color, vertex.uv, vertex.normal, vertex.normal };
+			vertexOut.position = worldViewProjectionMatrix.TransformPoint({ vertex.position, 1.0f });
 
 
-				Vector2 uvInterpolated0{ weightV0 * (v0.uv / v0.position.w) };
-				Vector2 uvInterpolated1{ weightV1 * (v1.uv / v1.position.w) };
-				Vector2 uvInterpolated2{ weightV2 * (v2.uv / v2.position.w) };
+			vertexOut.viewDirection = Vector3{ vertexOut.position.x, vertexOut.position.y, vertexOut.position.z }.Normalized();
 
-				interpolatedVertex.uv = { (uvInterpolated0 + uvInterpolated1 + uvInterpolated2) * interpolatedWWeight };
+			vertexOut.normal = worldMatrix.TransformVector(vertex.normal);
+			vertexOut.tangent = worldMatrix.TransformVector(vertex.tangent);
 
+			if (!frame.lights.empty())
+				vertexOut.worldPosition = worldMatrix.TransformPoint(vertex.position);
 
-				//color
-				interpolatedVertex.color = v0.color * weightV0 + v1.color * weightV1 + v2.color * weightV2;
 
-				//normal
-				Vector3 normalInterpolated0{ weightV0 * (v0.normal / v0.position.w) };
-				Vector3 normalInterpolated1{ weightV1 * (v1.normal / v1.position.w) };
-				Vector3 normalInterpolated2{ weightV2 * (v2.normal / v2.position.w) };
+			vertexOut.position.x /= vertexOut.position.w;
+			vertexOut.position.y /= vertexOut.position.w;
+			vertexOut.position.z /= vertexOut.position.w;
 
-				interpolatedVertex.normal = {
-					(
-					(normalInterpolated0 + normalInterpolated1 + normalInterpolated2)
-					* interpolatedWWeight
-					).Normalized() };
+			//Orthographic, so no divide, same texel mapping as the depth rasterizer
+			if (frame.useShadows)
+			{
+				const Vector4 lightPosition{ worldShadowMatrix.TransformPoint({ vertex.position, 1.0f }) };
+				vertexOut.shadowPosition = {
+					(lightPosition.x + 1) * 0.5f * m_ShadowMapSize,
+					(1.0f - lightPosition.y) * 0.5f * m_ShadowMapSize,
+					lightPosition.z };
+			}
 
-				//tangent
-				Vector3 tangentInterpolated0{ weightV0 * (v0.tangent / v0.position.w) };
-				Vector3 tangentInterpolated1{ weightV1 * (v1.tangent / v1.position.w) };
-				Vector3 tangentInterpolated2{ weightV2 * (v2.tangent / v2.position.w) };
+			frame.vertices.emplace_back(vertexOut);
+		}
+	}
 
-				interpolatedVertex.tangent = {
-					(
-					(tangentInterpolated0 + tangentInterpolated1 + tangentInterpolated2)
-					* interpolatedWWeight
-					).Normalized() };;
+}
 
+void Renderer::BinTriangle(FrameData& frame, int i0, int i1, int i2, uint64_t instanceKey)
+{
+	++frame.statistics.trianglesSubmitted;
 
+	if (PositionOutsideFrustrum(frame.vertices[i0].position) ||
+		PositionOutsideFrustrum(frame.vertices[i1].position) ||
+		PositionOutsideFrustrum(frame.vertices[i2].position))
+	{
+		++frame.statistics.trianglesCulled;
+		return;
+	}
 
-				//viewDir
-				Vector3 viewDirInterpolated0{ weightV0 * (v0.viewDirection / v0.position.w) };
-				Vector3 viewDirInterpolated1{ weightV1 * (v1.viewDirection / v1.position.w) };
-				Vector3 viewDirInterpolated2{ weightV2 * (v2.viewDirection / v2.position.w) };
+	const Vector2& v0{ frame.screenVertices[i0] };
+	const Vector2& v1{ frame.screenVertices[i1] };
+	const Vector2& v2{ frame.screenVertices[i2] };
 
-				interpolatedVertex.viewDirection = {
-					(
-					(viewDirInterpolated0 + viewDirInterpolated1 + viewDirInterpolated2)
-					* interpolatedWWeight
-					).Normalized() };;
+	const Vector2 minBB{ Vector2::Min(v0, Vector2::Min(v1, v2)) };
+	const Vector2 maxBB{ Vector2::Max(v0, Vector2::Max(v1, v2)) };
 
+	BinnedTriangle triangle{ i0, i1, i2 };
+	triangle.startX = std::clamp(static_cast<int>(minBB.x) - 1, 0, frame.width);
+	triangle.startY = std::clamp(static_cast<int>(minBB.y) - 1, 0, frame.height);
+	triangle.endX = std::clamp(static_cast<int>(maxBB.x) + 1, 0, frame.width);
+	triangle.endY = std::clamp(static_cast<int>(maxBB.y) + 1, 0, frame.height);
 
-				ColorRGB finalColor = PixelShading(interpolatedVertex);
+	//The unpadded bounds, a triangle is only clipped when part of it lies off screen
+	if (minBB.x < 0.f || minBB.y < 0.f || maxBB.x >= static_cast<float>(frame.width) || maxBB.y >= static_cast<float>(frame.height))
+		++frame.statistics.trianglesClipped;
 
-				finalColor.MaxToOne();
+	if (triangle.startX >= triangle.endX || triangle.startY >= triangle.endY)
+		return;
 
-				m_pBackBufferPixels[pixelIndex] = SDL_MapRGB(m_pBackBuffer->format,
-					static_cast<uint8_t>(finalColor.r * 255),
-					static_cast<uint8_t>(finalColor.g * 255),
-					static_cast<uint8_t>(finalColor.b * 255));
-			}
-			break;
+	const uint32_t triangleIndex{ static_cast<uint32_t>(frame.triangles.size()) };
+	frame.triangles.push_back(triangle);
 
-			break;
-			case dae::Renderer::RenderMode::Depth:
+	const int nrTilesX{ frame.nrTilesX };
+	const int firstTileX{ triangle.startX / m_TileSize }, lastTileX{ (triangle.endX - 1) / m_TileSize };
+	const int firstTileY{ triangle.startY / m_TileSize }, lastTileY{ (triangle.endY - 1) / m_TileSize };
+
+	for (int tileY{ firstTileY }; tileY <= lastTileY; ++tileY)
+	{
+		for (int tileX{ firstTileX }; tileX <= lastTileX; ++tileX)
+		{
+			Tile& tile{ frame.tiles[tileX + tileY * nrTilesX] };
+			tile.triangles.push_back(triangleIndex);
+
+			//Once per instance, the triangles of an instance are binned one after the other
+			if (tile.lastInstanceKey != instanceKey)
 			{
-				float depthVal = Remap(interpolatedZDepth, 0.997f, 1.0f);
+				tile.instancesKey = HashValue(instanceKey, tile.instancesKey);
+				tile.lastInstanceKey = instanceKey;
+			}
+		}
+	}
+}
+
+Renderer::TileKernel Renderer::SelectTileKernel(RenderMode renderMode, ColorMode colorMode, bool useNormalMap)
+{
+	//Depth output does not shade, every color mode and normal map setting uses the same kernel
+	if (renderMode == RenderMode::Depth)
+		return &Renderer::RenderTile<RenderMode::Depth, ColorMode::ObservedArea, false>;
 
-				ColorRGB finalColor{ depthVal, depthVal, depthVal };
+	//Indexed by color mode, then by normal map
+	static constexpr TileKernel textureKernels[][2]
+	{
+		{ &Renderer::RenderTile<RenderMode::Texture, ColorMode::ObservedArea, false>, &Renderer::RenderTile<RenderMode::Texture, ColorMode::ObservedArea, true> },
+		{ &Renderer::RenderTile<RenderMode::Texture, ColorMode::Diffuse, false>, &Renderer::RenderTile<RenderMode::Texture, ColorMode::Diffuse, true> },
+		{ &Renderer::RenderTile<RenderMode::Texture, ColorMode::Specular, false>, &Renderer::RenderTile<RenderMode::Texture, ColorMode::Specular, true> },
+		{ &Renderer::RenderTile<RenderMode::Texture, ColorMode::FinalColor, false>, &Renderer::RenderTile<RenderMode::Texture, ColorMode::FinalColor, true> },
+	};
+
+	return textureKernels[static_cast<int>(colorMode)][useNormalMap];
+}
 
-				m_pBackBufferPixels[pixelIndex] = SDL_MapRGB(m_pBackBuffer->format,
-					static_cast<uint8_t>(finalColor.r * 255),
-					static_cast<uint8_t>(finalColor.g * 255),
-					static_cast<uint8_t>(finalColor.b * 255));
+template<Renderer::RenderMode renderMode, Renderer::ColorMode colorMode, bool useNormalMap>
+void Renderer::RenderTile(const FrameData& frame, const Tile& tile, PipelineStatistics& statistics)
+{
+	PROFILE_SCOPE("Tile");
+
+	//Outside the render size, or the framebuffer already holds the tile
+	if (tile.x0 >= tile.x1 || tile.y0 >= tile.y1 || tile.isUnchanged)
+		return;
+
+	//Tiles without triangles are never read back, so their clear can bypass the cache
+	if (frame.useLazyClear)
+	{
+		frame.pFrameBuffer->ClearRegion(tile.x0, tile.y0, tile.x1, tile.y1, colors::Black, frame.depthClearValue, tile.triangles.empty());
+		if (!frame.pFrameBuffer->IsDepthCompressed())
+			statistics.depthBytes += static_cast<uint64_t>(tile.x1 - tile.x0) * (tile.y1 - tile.y0) * frame.pFrameBuffer->GetDepthBytesPerPixel();
+	}
+
+	for (uint32_t triangleIndex : tile.triangles)
+		RenderTraingle<renderMode, colorMode, useNormalMap>(frame, frame.triangles[triangleIndex], tile, statistics);
+
+	//Detail of the finished tile, the next frame picks its shading rate from it
+	if (renderMode == RenderMode::Texture && frame.shadingRatePolicy == ShadingRatePolicy::Adaptive)
+	{
+		TileGradient& tileGradient{ m_TileGradients[tile.x0 / m_TileSize + tile.y0 / m_TileSize * frame.nrTilesX] };
+
+		//Only the clear color, geometry moving in is shaded at full rate first
+		tileGradient = TileGradient{};
+		if (tile.triangles.empty())
+			return;
+
+		//Only the shaded samples are compared, the pixels between them are copies at coarse rates and would hide detail
+		//At 4x4 the 2x2 samples are unknown, so a tile that loses 4x4 goes back to full rate
+		const int halfRateStep{ 2 * frame.samplesPerSide };
+		const int quarterRateStep{ 4 * frame.samplesPerSide };
+		const int readStep{ std::max(tile.shadingRate, halfRateStep) };
+		const int width{ tile.x1 - tile.x0 };
+		const int height{ tile.y1 - tile.y0 };
+		float luminances[m_TileSize * m_TileSize];
+		for (int y{}; y < height; y += readStep)
+		{
+			for (int x{}; x < width; x += readStep)
+			{
+				const ColorRGB color{ frame.pFrameBuffer->ReadColor(tile.x0 + x + (tile.y0 + y) * frame.pFrameBuffer->GetSampleWidth()) };
+				luminances[x + y * m_TileSize] = std::min(0.2126f * color.r + 0.7152f * color.g + 0.0722f * color.b, 1.0f);
 			}
-			break;
+		}
+
+		//Coarse samples are aligned to their size in the tile, so these are shading samples at either rate
+		const auto measureGradient = [&](int step)
+		{
+			float gradientSum{};
+			int nrGradientPixels{};
+			for (int y{}; y < height - step; y += step)
+			{
+				for (int x{}; x < width - step; x += step)
+				{
+					const float* pLuminance{ &luminances[x + y * m_TileSize] };
+					gradientSum += std::abs(pLuminance[step] - pLuminance[0]) + std::abs(pLuminance[step * m_TileSize] - pLuminance[0]);
+					++nrGradientPixels;
+				}
 			}
+			return nrGradientPixels > 0 ? gradientSum / nrGradientPixels : FLT_MAX;
+		};
+
+		if (readStep == halfRateStep)
+			tileGradient.halfRate = measureGradient(halfRateStep);
+		tileGradient.quarterRate = measureGradient(quarterRateStep);
+		tileGradient.shadingRate = tile.shadingRate / frame.samplesPerSide;
+	}
+}
+
+template<Renderer::RenderMode renderMode, Renderer::ColorMode colorMode, bool useNormalMap>
+void Renderer::RenderTraingle(const FrameData& frame, const BinnedTriangle& triangle, const Tile& tile, PipelineStatistics& statistics)
+{
+	const int i0{ triangle.i0 }, i1{ triangle.i1 }, i2{ triangle.i2 };
+
+	const Vector2& v0{ frame.screenVertices[i0] };
+	const Vector2& v1{ frame.screenVertices[i1] };
+	const Vector2& v2{ frame.screenVertices[i2] };
+
+	const Vector2 edge0{ v1 - v0 };
+	const Vector2 edge1{ v2 - v1 };
+	const Vector2 edge2{ v0 - v2 };
+
+	const float triangleArea{ Vector2::Cross(edge0, edge1) };
+
 
+	const Vector2 minBB{ Vector2::Min(v0, Vector2::Min(v1, v2)) };
+	const Vector2 maxBB{ Vector2::Max(v0, Vector2::Max(v1, v2)) };
+
+	//Depth after the perspective divide is linear in screen space, so it is a plane over the triangle
+	const float depth0{ frame.vertices[i0].position.z };
+	const float depth1{ frame.vertices[i1].position.z };
+	const float depth2{ frame.vertices[i2].position.z };
+
+	const Vector2 v0ToV2{ v2 - v0 };
+	const DepthPlane depthPlane{ v0.x, v0.y, depth0,
+		((depth1 - depth0) * v0ToV2.y - (depth2 - depth0) * edge0.y) / triangleArea,
+		((depth2 - depth0) * edge0.x - (depth1 - depth0) * v0ToV2.x) / triangleArea };
+
+
+	//Only the part of the bounding box inside this tile
+	const int startX{ std::max(triangle.startX, tile.x0) };
+	const int startY{ std::max(triangle.startY, tile.y0) };
+	const int endX{ std::min(triangle.endX, tile.x1) };
+	const int endY{ std::min(triangle.endY, tile.y1) };
+
+	FrameBuffer* pFrameBuffer{ frame.pFrameBuffer };
+	const int sampleWidth{ pFrameBuffer->GetSampleWidth() };
+
+	//Counted locally so the pixel loop does not write the members for every pixel
+	uint64_t nrPixelsTested{}, nrPixelsCovered{}, nrDepthPasses{}, nrDepthFails{}, nrShaderInvocations{}, nrHelperPixels{}, nrDepthBytes{};
+
+	//Nearest depth of the triangle, widened a little so rounding in the interpolation can never make HiZ reject a visible pixel
+	const float nearestDepth{ pFrameBuffer->QuantizeDepth(frame.isReversedZ ?
+		std::max(depth0, std::max(depth1, depth2)) * (1.0f + 4 * FLT_EPSILON) :
+		std::min(depth0, std::min(depth1, depth2)) * (1.0f - 4 * FLT_EPSILON)) };
+
+	const int blockSize{ FrameBuffer::CoarseBlockSize };
+	const float* pCoarseDepthPixels{ pFrameBuffer->GetCoarseDepthPixels() };
+	const int coarseWidth{ pFrameBuffer->GetCoarseWidth() };
+
+	uint64_t nrBlocks{}, nrBlocksRejected{}, nrPixelTestsAvoided{};
+
+	FragmentBatch batch;
+
+	//Pixels per side of a shading sample, the depth view writes every pixel itself
+	const int shadingRate{ renderMode == RenderMode::Texture ? tile.shadingRate : 1 };
+	const int rateShift{ std::countr_zero(static_cast<unsigned int>(shadingRate)) };
+	const int quadSize{ 2 * shadingRate };
+	const float sampleOffset{ (shadingRate - 1) * 0.5f };
+
+	//Triangle setup for the four lane pixel tests
+	const __m128 zero{ _mm_setzero_ps() };
+	const __m128 laneOffsetX{ _mm_setr_ps(0.0f, 1.0f, 0.0f, 1.0f) };
+	const __m128 laneOffsetY{ _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f) };
+	const __m128 minX{ _mm_set1_ps(minBB.x) }, maxX{ _mm_set1_ps(maxBB.x) };
+	const __m128 minY{ _mm_set1_ps(minBB.y) }, maxY{ _mm_set1_ps(maxBB.y) };
+	const __m128 v0X{ _mm_set1_ps(v0.x) }, v0Y{ _mm_set1_ps(v0.y) };
+	const __m128 v1X{ _mm_set1_ps(v1.x) }, v1Y{ _mm_set1_ps(v1.y) };
+	const __m128 v2X{ _mm_set1_ps(v2.x) }, v2Y{ _mm_set1_ps(v2.y) };
+	const __m128 edge0X{ _mm_set1_ps(edge0.x) }, edge0Y{ _mm_set1_ps(edge0.y) };
+	const __m128 edge1X{ _mm_set1_ps(edge1.x) }, edge1Y{ _mm_set1_ps(edge1.y) };
+	const __m128 edge2X{ _mm_set1_ps(edge2.x) }, edge2Y{ _mm_set1_ps(edge2.y) };
+	const __m128 planeDepth{ _mm_set1_ps(depthPlane.depth) };
+	const __m128 planeOriginX{ _mm_set1_ps(depthPlane.originX) }, planeOriginY{ _mm_set1_ps(depthPlane.originY) };
+	const __m128 planeGradientX{ _mm_set1_ps(depthPlane.gradientX) }, planeGradientY{ _mm_set1_ps(depthPlane.gradientY) };
+
+	//Walk the bounding box per 8x8 block, so blocks that are already covered by something closer are skipped as a whole
+	for (int blockY{ startY / blockSize }; blockY <= (endY - 1) / blockSize; ++blockY)
+	{
+		for (int blockX{ startX / blockSize }; blockX <= (endX - 1) / blockSize; ++blockX)
+		{
+			const int blockStartX{ std::max(startX, blockX * blockSize) };
+			const int blockStartY{ std::max(startY, blockY * blockSize) };
+			const int blockEndX{ std::min(endX, (blockX + 1) * blockSize) };
+			const int blockEndY{ std::min(endY, (blockY + 1) * blockSize) };
 
+			++nrBlocks;
 
+			//Every pixel of the block is closer than the closest point of the triangle
+			const float farthestDepth{ pCoarseDepthPixels[blockX + blockY * coarseWidth] };
+			if (frame.useHiZ && (frame.isReversedZ ? nearestDepth < farthestDepth : nearestDepth > farthestDepth))
+			{
+				++nrBlocksRejected;
+				nrPixelTestsAvoided += static_cast<uint64_t>(blockEndX - blockStartX) * (blockEndY - blockStartY);
+				continue;
+			}
 
+			//Depth is tested against a decoded copy of the block, compressed blocks do not touch memory
+			float blockDepth[FrameBuffer::NrBlockPixels];
+			nrDepthBytes += pFrameBuffer->LoadDepthBlock(blockX, blockY, blockDepth);
+			int nrBlockDepthPasses{};
+
+			//Quads of 2x2 shading samples, aligned to their size of at most 8x8 pixels so they never straddle a block
+			//Samples whose pixels are all outside the bounding box only serve as helpers
+			for (int quadY{ blockStartY & ~(quadSize - 1) }; quadY < blockEndY; quadY += quadSize)
+			{
+				for (int quadX{ blockStartX & ~(quadSize - 1) }; quadX < blockEndX; quadX += quadSize)
+				{
+					//Pixels that passed coverage and depth, per sample one bit for each of its pixels
+					int pixelMasks[4]{};
+
+					//2x2 pixels at a time, the lanes in quad order. The edge functions and the depth plane are evaluated for all four
+					//Lanes outside the block's part of the bounding box are not tested at all
+					for (int groupY{ quadY }; groupY < quadY + quadSize; groupY += 2)
+					{
+						const int rowMask{ (groupY >= blockStartY && groupY < blockEndY ? 0b0011 : 0) | (groupY + 1 >= blockStartY && groupY + 1 < blockEndY ? 0b1100 : 0) };
+						if (rowMask == 0)
+							continue;
+
+						const __m128 pixelY{ _mm_add_ps(_mm_set1_ps(static_cast<float>(groupY)), laneOffsetY) };
+
+						for (int groupX{ quadX }; groupX < quadX + quadSize; groupX += 2)
+						{
+							const int columnMask{ (groupX >= blockStartX && groupX < blockEndX ? 0b0101 : 0) | (groupX + 1 >= blockStartX && groupX + 1 < blockEndX ? 0b1010 : 0) };
+							const int testedMask{ rowMask & columnMask };
+							if (testedMask == 0)
+								continue;
+
+							nrPixelsTested += std::popcount(static_cast<unsigned int>(testedMask));
+
+							const __m128 pixelX{ _mm_add_ps(_mm_set1_ps(static_cast<float>(groupX)), laneOffsetX) };
+
+							const __m128 isInBoundingBox{ _mm_and_ps(
+								_mm_and_ps(_mm_cmpge_ps(pixelX, minX), _mm_cmple_ps(pixelX, maxX)),
+								_mm_and_ps(_mm_cmpge_ps(pixelY, minY), _mm_cmple_ps(pixelY, maxY))) };
+
+							//Same as Vector2::Cross(edge, pixel - vertex)
+							const auto edgeFunction = [&](__m128 edgeX, __m128 edgeY, __m128 vertexX, __m128 vertexY)
+							{
+								return _mm_sub_ps(_mm_mul_ps(edgeX, _mm_sub_ps(pixelY, vertexY)), _mm_mul_ps(edgeY, _mm_sub_ps(pixelX, vertexX)));
+							};
+							const __m128 isInside{ _mm_and_ps(_mm_and_ps(
+								_mm_cmpgt_ps(edgeFunction(edge0X, edge0Y, v0X, v0Y), zero),
+								_mm_cmpgt_ps(edgeFunction(edge1X, edge1Y, v1X, v1Y), zero)),
+								_mm_cmpgt_ps(edgeFunction(edge2X, edge2Y, v2X, v2Y), zero)) };
+
+							const int coveredMask{ _mm_movemask_ps(_mm_and_ps(isInBoundingBox, isInside)) & testedMask };
+							if (coveredMask == 0)
+								continue;
+
+							nrPixelsCovered += std::popcount(static_cast<unsigned int>(coveredMask));
+
+							//Same as DepthPlane::At
+							alignas(16) float depths[4];
+							_mm_store_ps(depths, _mm_add_ps(
+								_mm_add_ps(planeDepth, _mm_mul_ps(_mm_sub_ps(pixelX, planeOriginX), planeGradientX)),
+								_mm_mul_ps(_mm_sub_ps(pixelY, planeOriginY), planeGradientY)));
+
+							for (int laneMask{ coveredMask }; laneMask != 0; laneMask &= laneMask - 1)
+							{
+								const int lane{ std::countr_zero(static_cast<unsigned int>(laneMask)) };
+								const int px{ groupX + (lane & 1) };
+								const int py{ groupY + (lane >> 1) };
+
+								const float interpolatedZDepth{ depths[lane] };
+								const float quantizedDepth{ pFrameBuffer->QuantizeDepth(interpolatedZDepth) };
+
+								//Closer is larger with reversed-Z
+								const int blockPixelIndex{ (px - blockX * blockSize) + (py - blockY * blockSize) * blockSize };
+								const float storedDepth{ blockDepth[blockPixelIndex] };
+								if (interpolatedZDepth < 0.0f || interpolatedZDepth > 1.0f ||
+									(frame.isReversedZ ? storedDepth > quantizedDepth : storedDepth < quantizedDepth))
+								{
+									++nrDepthFails;
+									continue;
+								}
+
+								++nrDepthPasses;
+								blockDepth[blockPixelIndex] = quantizedDepth;
+								++nrBlockDepthPasses;
+
+								const int quadOffsetX{ px - quadX };
+								const int quadOffsetY{ py - quadY };
+								pixelMasks[(quadOffsetX >> rateShift) + (quadOffsetY >> rateShift) * 2] |=
+									1 << ((quadOffsetX & (shadingRate - 1)) + (quadOffsetY & (shadingRate - 1)) * shadingRate);
+
+								if constexpr (renderMode == RenderMode::Depth)
+								{
+									//Same look as before, reversed depth is one minus the regular depth
+									float depthVal = Remap(frame.isReversedZ ? 1.0f - interpolatedZDepth : interpolatedZDepth, 0.997f, 1.0f);
+
+									pFrameBuffer->WriteColor(px + py * sampleWidth, ColorRGB{ depthVal, depthVal, depthVal });
+								}
+							}
+						}
+					}
+					//Shaded once the batch is full or the triangle is done
+					if constexpr (renderMode == RenderMode::Texture)
+					{
+						if ((pixelMasks[0] | pixelMasks[1] | pixelMasks[2] | pixelMasks[3]) == 0)
+							continue;
+
+						for (int sample{}; sample < 4; ++sample)
+						{
+							const int sampleX{ quadX + (sample & 1) * shadingRate };
+							const int sampleY{ quadY + (sample >> 1) * shadingRate };
+							//Center of the sample's pixels, helpers extrapolate the attributes outside the triangle
+							Vector2 samplePoint{ sampleX + sampleOffset, sampleY + sampleOffset };
+							float edge0SampleCross{ Vector2::Cross(edge0, samplePoint - v0) };
+							float edge1SampleCross{ Vector2::Cross(edge1, samplePoint - v1) };
+							float edge2SampleCross{ Vector2::Cross(edge2, samplePoint - v2) };
+
+							//Like centroid sampling, a coarse sample whose center misses the triangle moves to its first covered pixel
+							//so its uvs stay inside the texture
+							if (pixelMasks[sample] != 0 && !(edge0SampleCross > 0 && edge1SampleCross > 0 && edge2SampleCross > 0))
+							{
+								const int pixel{ std::countr_zero(static_cast<unsigned int>(pixelMasks[sample])) };
+								samplePoint = Vector2{ static_cast<float>(sampleX + (pixel & (shadingRate - 1))), static_cast<float>(sampleY + (pixel >> rateShift)) };
+								edge0SampleCross = Vector2::Cross(edge0, samplePoint - v0);
+								edge1SampleCross = Vector2::Cross(edge1, samplePoint - v1);
+								edge2SampleCross = Vector2::Cross(edge2, samplePoint - v2);
+							}
+
+							const int lane{ batch.count + sample };
+							batch.pixelIndices[lane] = sampleX + sampleY * sampleWidth;
+							batch.pixelMasks[lane] = pixelMasks[sample];
+							batch.weights[0][lane] = edge1SampleCross / triangleArea;
+							batch.weights[1][lane] = edge2SampleCross / triangleArea;
+							batch.weights[2][lane] = edge0SampleCross / triangleArea;
+
+							if (pixelMasks[sample] != 0)
+								++nrShaderInvocations;
+							else
+								++nrHelperPixels;
+						}
+
+						batch.count += 4;
+						if (batch.count == FragmentBatch::Size)
+							ShadeFragments<colorMode, useNormalMap>(frame, triangle, tile, batch);
+					}
+				}
+			}
+
+			if (nrBlockDepthPasses > 0)
+			{
+				//Every pixel of the block now lies on this triangle's plane
+				if (pFrameBuffer->IsDepthCompressed() && nrBlockDepthPasses == FrameBuffer::NrBlockPixels)
+					pFrameBuffer->StoreDepthBlockPlane(blockX, blockY, depthPlane);
+				else
+					nrDepthBytes += pFrameBuffer->StoreDepthBlock(blockX, blockY, blockDepth);
+
+				if (frame.useHiZ)
+					pFrameBuffer->UpdateCoarseDepth(blockX, blockY, blockDepth, frame.isReversedZ);
+			}
 		}
 	}
+
+	if constexpr (renderMode == RenderMode::Texture)
+	{
+		if (batch.count > 0)
+			ShadeFragments<colorMode, useNormalMap>(frame, triangle, tile, batch);
+	}
+
+	if (nrBlocks > 0 && nrBlocksRejected == nrBlocks)
+		++statistics.hiZTrianglesRejected;
+
+	statistics.hiZBlocksRejected += nrBlocksRejected;
+	statistics.hiZPixelTestsAvoided += nrPixelTestsAvoided;
+	statistics.boundingBoxPixelsTested += nrPixelsTested;
+	statistics.pixelsCovered += nrPixelsCovered;
+	statistics.depthTestsPassed += nrDepthPasses;
+	statistics.depthTestsFailed += nrDepthFails;
+	statistics.shaderInvocations += nrShaderInvocations;
+	statistics.helperPixels += nrHelperPixels;
+	statistics.depthBytes += nrDepthBytes;
+	statistics.lightEvaluations += nrShaderInvocations * tile.lights.size();
 }
 
 
@@ -342,71 +1316,405 @@ bool Renderer::PositionOutsideFrustrum(const Vector4& v)
 	return v.x < -1.0f || v.x > 1.0f || v.y < -1.0f || v.y > 1.0f;;
 }
 
-ColorRGB Renderer::PixelShading(const Vertex_Out& v)
+template<Renderer::ColorMode colorMode, bool useNormalMap>
+void Renderer::ShadeFragments(const FrameData& frame, const BinnedTriangle& triangle, const Tile& tile, FragmentBatch& batch) const
 {
+	//Whole quads only, so count is a multiple of four
+	const int count{ batch.count };
+	batch.count = 0;
 
-	Vector3 pixelNormal{ v.normal };
+	const Vertex_Out& v0{ frame.vertices[triangle.i0] };
+	const Vertex_Out& v1{ frame.vertices[triangle.i1] };
+	const Vertex_Out& v2{ frame.vertices[triangle.i2] };
 
+	const __m128 w0{ _mm_set1_ps(v0.position.w) }, w1{ _mm_set1_ps(v1.position.w) }, w2{ _mm_set1_ps(v2.position.w) };
+	//Derivatives per pixel, not per sample of the MSAA grid
+	const __m128 inverseShadingRate{ _mm_set1_ps(static_cast<float>(frame.samplesPerSide) / tile.shadingRate) };
 
-	if (m_UseNormalMap)
+	//Perspective correct interpolation, four fragments at a time
+	for (int lane{}; lane < count; lane += 4)
 	{
-		Vector3 binormal = Vector3::Cross(v.normal, v.tangent);
+		const __m128 weightV0{ _mm_load_ps(&batch.weights[0][lane]) };
+		const __m128 weightV1{ _mm_load_ps(&batch.weights[1][lane]) };
+		const __m128 weightV2{ _mm_load_ps(&batch.weights[2][lane]) };
 
-		Matrix tangentSpaceAxis = Matrix{ v.tangent, binormal, v.normal, Vector3::Zero };
+		const __m128 interpolatedWWeight{ _mm_div_ps(_mm_set1_ps(1.0f),
+			_mm_add_ps(_mm_add_ps(_mm_div_ps(weightV0, w0), _mm_div_ps(weightV1, w1)), _mm_div_ps(weightV2, w2))) };
 
-		ColorRGB currentNormalMap{ 2.0f * m_pNormalMap->Sample(v.uv) - ColorRGB{ 1.0f, 1.0f, 1.0f } };
-
-		Vector3 normalMapSample{ currentNormalMap.r, currentNormalMap.g, currentNormalMap.b };
+		const auto interpolate{ [&](float attribute0, float attribute1, float attribute2)
+			{
+				const __m128 interpolated0{ _mm_mul_ps(weightV0, _mm_set1_ps(attribute0 / v0.position.w)) };
+				const __m128 interpolated1{ _mm_mul_ps(weightV1, _mm_set1_ps(attribute1 / v1.position.w)) };
+				const __m128 interpolated2{ _mm_mul_ps(weightV2, _mm_set1_ps(attribute2 / v2.position.w)) };
+				return _mm_mul_ps(_mm_add_ps(_mm_add_ps(interpolated0, interpolated1), interpolated2), interpolatedWWeight);
+			} };
+
+		const __m128 u{ interpolate(v0.uv.x, v1.uv.x, v2.uv.x) };
+		const __m128 v{ interpolate(v0.uv.y, v1.uv.y, v2.uv.y) };
+		_mm_store_ps(&batch.uvs[0][lane], u);
+		_mm_store_ps(&batch.uvs[1][lane], v);
+
+		//The four lanes are one quad, so the derivatives are differences between neighbouring lanes, shading rate pixels apart
+		_mm_store_ps(&batch.uvDdx[0][lane], _mm_mul_ps(QuadDdx(u), inverseShadingRate));
+		_mm_store_ps(&batch.uvDdx[1][lane], _mm_mul_ps(QuadDdx(v), inverseShadingRate));
+		_mm_store_ps(&batch.uvDdy[0][lane], _mm_mul_ps(QuadDdy(u), inverseShadingRate));
+		_mm_store_ps(&batch.uvDdy[1][lane], _mm_mul_ps(QuadDdy(v), inverseShadingRate));
+
+		__m128 normalX{ interpolate(v0.normal.x, v1.normal.x, v2.normal.x) };
+		__m128 normalY{ interpolate(v0.normal.y, v1.normal.y, v2.normal.y) };
+		__m128 normalZ{ interpolate(v0.normal.z, v1.normal.z, v2.normal.z) };
+		Normalize(normalX, normalY, normalZ);
+		_mm_store_ps(&batch.normals[0][lane], normalX);
+		_mm_store_ps(&batch.normals[1][lane], normalY);
+		_mm_store_ps(&batch.normals[2][lane], normalZ);
+
+		__m128 tangentX{ interpolate(v0.tangent.x, v1.tangent.x, v2.tangent.x) };
+		__m128 tangentY{ interpolate(v0.tangent.y, v1.tangent.y, v2.tangent.y) };
+		__m128 tangentZ{ interpolate(v0.tangent.z, v1.tangent.z, v2.tangent.z) };
+		Normalize(tangentX, tangentY, tangentZ);
+		_mm_store_ps(&batch.tangents[0][lane], tangentX);
+		_mm_store_ps(&batch.tangents[1][lane], tangentY);
+		_mm_store_ps(&batch.tangents[2][lane], tangentZ);
+
+		__m128 viewDirectionX{ interpolate(v0.viewDirection.x, v1.viewDirection.x, v2.viewDirection.x) };
+		__m128 viewDirectionY{ interpolate(v0.viewDirection.y, v1.viewDirection.y, v2.viewDirection.y) };
+		__m128 viewDirectionZ{ interpolate(v0.viewDirection.z, v1.viewDirection.z, v2.viewDirection.z) };
+		Normalize(viewDirectionX, viewDirectionY, viewDirectionZ);
+		_mm_store_ps(&batch.viewDirections[0][lane], viewDirectionX);
+		_mm_store_ps(&batch.viewDirections[1][lane], viewDirectionY);
+		_mm_store_ps(&batch.viewDirections[2][lane], viewDirectionZ);
+
+		if (frame.useShadows)
+		{
+			_mm_store_ps(&batch.shadowPositions[0][lane], interpolate(v0.shadowPosition.x, v1.shadowPosition.x, v2.shadowPosition.x));
+			_mm_store_ps(&batch.shadowPositions[1][lane], interpolate(v0.shadowPosition.y, v1.shadowPosition.y, v2.shadowPosition.y));
+			_mm_store_ps(&batch.shadowPositions[2][lane], interpolate(v0.shadowPosition.z, v1.shadowPosition.z, v2.shadowPosition.z));
+		}
 
-		pixelNormal = tangentSpaceAxis.TransformVector(normalMapSample).Normalized();
+		if (!tile.lights.empty())
+		{
+			_mm_store_ps(&batch.worldPositions[0][lane], interpolate(v0.worldPosition.x, v1.worldPosition.x, v2.worldPosition.x));
+			_mm_store_ps(&batch.worldPositions[1][lane], interpolate(v0.worldPosition.y, v1.worldPosition.y, v2.worldPosition.y));
+			_mm_store_ps(&batch.worldPositions[2][lane], interpolate(v0.worldPosition.z, v1.worldPosition.z, v2.worldPosition.z));
+		}
 	}
 
-	Vector3 lightDirection = Vector3{ .577f, -.577f, .577f }.Normalized();
+	//Texture lookups stay scalar, the samples are gathered into arrays first
+	alignas(16) float normalSamples[3][FragmentBatch::Size];
+	alignas(16) float diffuseSamples[3][FragmentBatch::Size];
+	alignas(16) float specularSamples[3][FragmentBatch::Size];
+	alignas(16) float phongExponents[FragmentBatch::Size];
+	alignas(16) float lightVisibilities[FragmentBatch::Size];
+	alignas(16) float colors[3][FragmentBatch::Size];
 
-	const float observedArea{ std::max(Vector3::Dot(pixelNormal, -lightDirection), 0.f) };
-	const float lightIntensity{ 7.0f };
-	const float glossyness{ 25.0f };
+	constexpr bool useDiffuse{ colorMode == ColorMode::Diffuse || colorMode == ColorMode::FinalColor };
+	constexpr bool useSpecular{ colorMode == ColorMode::Specular || colorMode == ColorMode::FinalColor };
 
-
-	switch (m_CurrentColorMode)
-	{
-	case dae::Renderer::ColorMode::ObservedArea:
-		return ColorRGB{ observedArea, observedArea, observedArea };
-		break;
-	case dae::Renderer::ColorMode::Diffuse:
+	for (int lane{}; lane < count; ++lane)
 	{
+		//Helper lanes can lie outside the triangle and its uv range, they reuse a live sample of their quad
+		int fragment{ lane & ~3 };
+		if (batch.pixelMasks[lane] != 0)
+			fragment = lane;
+		else
+		{
+			while (batch.pixelMasks[fragment] == 0)
+				++fragment;
+		}
+		const Vector2 uv{ batch.uvs[0][fragment], batch.uvs[1][fragment] };
 
-		const ColorRGB lambert{ 1.0f * m_pDiffuseMap->Sample(v.uv) / PI };
-
-		return (lightIntensity * lambert) * observedArea;
+		if constexpr (useNormalMap)
+		{
+			const ColorRGB normalMapSample{ m_pNormalMap->Sample(uv) };
+			normalSamples[0][lane] = normalMapSample.r;
+			normalSamples[1][lane] = normalMapSample.g;
+			normalSamples[2][lane] = normalMapSample.b;
+		}
+		if constexpr (useDiffuse)
+		{
+			const ColorRGB diffuseSample{ m_pDiffuseMap->Sample(uv) };
+			diffuseSamples[0][lane] = diffuseSample.r;
+			diffuseSamples[1][lane] = diffuseSample.g;
+			diffuseSamples[2][lane] = diffuseSample.b;
+		}
+		if constexpr (useSpecular)
+		{
+			const ColorRGB specularSample{ m_pSpecularMap->Sample(uv) };
+			specularSamples[0][lane] = specularSample.r;
+			specularSamples[1][lane] = specularSample.g;
+			specularSamples[2][lane] = specularSample.b;
+			phongExponents[lane] = m_pGlossMap->Sample(uv).r;
+		}
 	}
-	break;
-	case dae::Renderer::ColorMode::Specular:
+
+	const __m128 one{ _mm_set1_ps(1.0f) }, two{ _mm_set1_ps(2.0f) }, zero{ _mm_setzero_ps() };
+	//Towards the light
+	const __m128 lightX{ _mm_set1_ps(-m_LightDirection.x) }, lightY{ _mm_set1_ps(-m_LightDirection.y) }, lightZ{ _mm_set1_ps(-m_LightDirection.z) };
+	const __m128 lightIntensity{ _mm_set1_ps(7.0f) };
+	const __m128 glossyness{ _mm_set1_ps(25.0f) };
+
+	for (int lane{}; lane < count; lane += 4)
 	{
-		const float phongExponent{ m_pGlossMap->Sample(v.uv).r * glossyness };
+		__m128 normalX{ _mm_load_ps(&batch.normals[0][lane]) };
+		__m128 normalY{ _mm_load_ps(&batch.normals[1][lane]) };
+		__m128 normalZ{ _mm_load_ps(&batch.normals[2][lane]) };
+
+		if constexpr (useNormalMap)
+		{
+			const __m128 tangentX{ _mm_load_ps(&batch.tangents[0][lane]) };
+			const __m128 tangentY{ _mm_load_ps(&batch.tangents[1][lane]) };
+			const __m128 tangentZ{ _mm_load_ps(&batch.tangents[2][lane]) };
+
+			const __m128 binormalX{ _mm_sub_ps(_mm_mul_ps(normalY, tangentZ), _mm_mul_ps(normalZ, tangentY)) };
+			const __m128 binormalY{ _mm_sub_ps(_mm_mul_ps(normalZ, tangentX), _mm_mul_ps(normalX, tangentZ)) };
+			const __m128 binormalZ{ _mm_sub_ps(_mm_mul_ps(normalX, tangentY), _mm_mul_ps(normalY, tangentX)) };
+
+			//From [0, 1] to [-1, 1], then from tangent space to world space
+			const __m128 sampleX{ _mm_sub_ps(_mm_mul_ps(two, _mm_load_ps(&normalSamples[0][lane])), one) };
+			const __m128 sampleY{ _mm_sub_ps(_mm_mul_ps(two, _mm_load_ps(&normalSamples[1][lane])), one) };
+			const __m128 sampleZ{ _mm_sub_ps(_mm_mul_ps(two, _mm_load_ps(&normalSamples[2][lane])), one) };
+
+			__m128 mappedX{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(tangentX, sampleX), _mm_mul_ps(binormalX, sampleY)), _mm_mul_ps(normalX, sampleZ)) };
+			__m128 mappedY{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(tangentY, sampleX), _mm_mul_ps(binormalY, sampleY)), _mm_mul_ps(normalY, sampleZ)) };
+			__m128 mappedZ{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(tangentZ, sampleX), _mm_mul_ps(binormalZ, sampleY)), _mm_mul_ps(normalZ, sampleZ)) };
+			Normalize(mappedX, mappedY, mappedZ);
+
+			normalX = mappedX;
+			normalY = mappedY;
+			normalZ = mappedZ;
+		}
+
+		const __m128 lightCosine{ _mm_max_ps(Dot(normalX, normalY, normalZ, lightX, lightY, lightZ), zero) };
+		__m128 lightVisibility{ one };
+
+		if (frame.useShadows)
+		{
+			alignas(16) float lightCosines[4];
+			_mm_store_ps(lightCosines, lightCosine);
+
+			for (int i{}; i < 4; ++i)
+			{
+				const int fragment{ lane + i };
+				const Vector3 shadowPosition{ batch.shadowPositions[0][fragment], batch.shadowPositions[1][fragment], batch.shadowPositions[2][fragment] };
+				lightVisibilities[fragment] = lightCosines[i] > 0.f && batch.pixelMasks[fragment] != 0 ? SampleShadowMap(frame, shadowPosition, lightCosines[i]) : 1.0f;
+			}
+			lightVisibility = _mm_load_ps(&lightVisibilities[lane]);
+		}
+
+		const __m128 observedArea{ _mm_mul_ps(lightCosine, lightVisibility) };
+
+		//Lambert
+		__m128 lambertR{}, lambertG{}, lambertB{};
+		__m128 diffuseR{}, diffuseG{}, diffuseB{};
+		if constexpr (useDiffuse)
+		{
+			const __m128 pi{ _mm_set1_ps(PI) };
+			lambertR = _mm_div_ps(_mm_load_ps(&diffuseSamples[0][lane]), pi);
+			lambertG = _mm_div_ps(_mm_load_ps(&diffuseSamples[1][lane]), pi);
+			lambertB = _mm_div_ps(_mm_load_ps(&diffuseSamples[2][lane]), pi);
+			diffuseR = _mm_mul_ps(lambertR, lightIntensity);
+			diffuseG = _mm_mul_ps(lambertG, lightIntensity);
+			diffuseB = _mm_mul_ps(lambertB, lightIntensity);
+		}
+
+		//Phong
+		__m128 viewDirectionX{}, viewDirectionY{}, viewDirectionZ{}, phongExponent{};
+		__m128 specularSampleR{}, specularSampleG{}, specularSampleB{};
+		if constexpr (useSpecular)
+		{
+			viewDirectionX = _mm_load_ps(&batch.viewDirections[0][lane]);
+			viewDirectionY = _mm_load_ps(&batch.viewDirections[1][lane]);
+			viewDirectionZ = _mm_load_ps(&batch.viewDirections[2][lane]);
+			phongExponent = _mm_mul_ps(_mm_load_ps(&phongExponents[lane]), glossyness);
+			specularSampleR = _mm_load_ps(&specularSamples[0][lane]);
+			specularSampleG = _mm_load_ps(&specularSamples[1][lane]);
+			specularSampleB = _mm_load_ps(&specularSamples[2][lane]);
+		}
+
+		const auto phongLobe{ [&](__m128 towardsLightX, __m128 towardsLightY, __m128 towardsLightZ)
+			{
+				const __m128 lightNormalDot{ _mm_mul_ps(two, Dot(towardsLightX, towardsLightY, towardsLightZ, normalX, normalY, normalZ)) };
+				const __m128 reflectedX{ _mm_sub_ps(towardsLightX, _mm_mul_ps(lightNormalDot, normalX)) };
+				const __m128 reflectedY{ _mm_sub_ps(towardsLightY, _mm_mul_ps(lightNormalDot, normalY)) };
+				const __m128 reflectedZ{ _mm_sub_ps(towardsLightZ, _mm_mul_ps(lightNormalDot, normalZ)) };
+
+				const __m128 reflectedViewDot{ _mm_max_ps(Dot(reflectedX, reflectedY, reflectedZ, viewDirectionX, viewDirectionY, viewDirectionZ), zero) };
+				if (frame.useFastSpecular)
+					return FastPow(reflectedViewDot, phongExponent);
+
+				alignas(16) float bases[4], exponents[4], results[4];
+				_mm_store_ps(bases, reflectedViewDot);
+				_mm_store_ps(exponents, phongExponent);
+				for (int i{}; i < 4; ++i)
+					results[i] = powf(bases[i], exponents[i]);
+				return _mm_load_ps(results);
+			} };
+
+		__m128 specularR{}, specularG{}, specularB{};
+		if constexpr (useSpecular)
+		{
+			const __m128 phong{ phongLobe(lightX, lightY, lightZ) };
+			specularR = _mm_mul_ps(specularSampleR, phong);
+			specularG = _mm_mul_ps(specularSampleG, phong);
+			specularB = _mm_mul_ps(specularSampleB, phong);
+		}
+
+		__m128 red{}, green{}, blue{};
+		if constexpr (colorMode == ColorMode::ObservedArea)
+		{
+			red = green = blue = observedArea;
+		}
+		else if constexpr (colorMode == ColorMode::Diffuse)
+		{
+			red = _mm_mul_ps(diffuseR, observedArea);
+			green = _mm_mul_ps(diffuseG, observedArea);
+			blue = _mm_mul_ps(diffuseB, observedArea);
+		}
+		else if constexpr (colorMode == ColorMode::Specular)
+		{
+			red = _mm_mul_ps(specularR, lightVisibility);
+			green = _mm_mul_ps(specularG, lightVisibility);
+			blue = _mm_mul_ps(specularB, lightVisibility);
+		}
+		else
+		{
+			red = _mm_mul_ps(_mm_add_ps(diffuseR, specularR), observedArea);
+			green = _mm_mul_ps(_mm_add_ps(diffuseG, specularG), observedArea);
+			blue = _mm_mul_ps(_mm_add_ps(diffuseB, specularB), observedArea);
+		}
+
+		//Point and spot lights of the tile, same shading as the directional light without shadows
+		if (!tile.lights.empty())
+		{
+			const __m128 positionX{ _mm_load_ps(&batch.worldPositions[0][lane]) };
+			const __m128 positionY{ _mm_load_ps(&batch.worldPositions[1][lane]) };
+			const __m128 positionZ{ _mm_load_ps(&batch.worldPositions[2][lane]) };
+
+			for (uint32_t lightIndex : tile.lights)
+			{
+				const FrameLight& light{ frame.lights[lightIndex] };
+
+				__m128 towardsLightX{ _mm_sub_ps(_mm_set1_ps(light.position.x), positionX) };
+				__m128 towardsLightY{ _mm_sub_ps(_mm_set1_ps(light.position.y), positionY) };
+				__m128 towardsLightZ{ _mm_sub_ps(_mm_set1_ps(light.position.z), positionZ) };
+				const __m128 distanceSquared{ Dot(towardsLightX, towardsLightY, towardsLightZ, towardsLightX, towardsLightY, towardsLightZ) };
+
+				//Smooth window that reaches zero at the light's radius, most lights of a tile miss most of its fragments
+				const __m128 window{ _mm_max_ps(_mm_sub_ps(one, _mm_mul_ps(distanceSquared, _mm_set1_ps(light.inverseRadiusSquared))), zero) };
+				__m128 attenuation{ _mm_mul_ps(window, window) };
+				if (_mm_movemask_ps(_mm_cmpgt_ps(attenuation, zero)) == 0)
+					continue;
+
+				const __m128 inverseDistance{ _mm_div_ps(one, _mm_sqrt_ps(_mm_max_ps(distanceSquared, _mm_set1_ps(FLT_MIN)))) };
+				towardsLightX = _mm_mul_ps(towardsLightX, inverseDistance);
+				towardsLightY = _mm_mul_ps(towardsLightY, inverseDistance);
+				towardsLightZ = _mm_mul_ps(towardsLightZ, inverseDistance);
 
-		return m_pSpecularMap->Sample(v.uv) * BRDF_Utils::Phong(1.0f, phongExponent, -lightDirection, v.viewDirection, pixelNormal);
+				if (light.isSpot)
+				{
+					const __m128 coneCosine{ Dot(towardsLightX, towardsLightY, towardsLightZ,
+						_mm_set1_ps(light.spotDirection.x), _mm_set1_ps(light.spotDirection.y), _mm_set1_ps(light.spotDirection.z)) };
+					const __m128 cone{ _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(coneCosine, _mm_set1_ps(light.cosOuterCone)), _mm_set1_ps(light.inverseConeRange)), zero), one) };
+					attenuation = _mm_mul_ps(attenuation, _mm_mul_ps(cone, cone));
+				}
+
+				const __m128 pointLightCosine{ _mm_max_ps(Dot(normalX, normalY, normalZ, towardsLightX, towardsLightY, towardsLightZ), zero) };
+				const __m128 pointObservedArea{ _mm_mul_ps(pointLightCosine, attenuation) };
+
+				if constexpr (colorMode == ColorMode::ObservedArea)
+				{
+					red = _mm_add_ps(red, pointObservedArea);
+					green = _mm_add_ps(green, pointObservedArea);
+					blue = _mm_add_ps(blue, pointObservedArea);
+				}
+				else if constexpr (colorMode == ColorMode::Diffuse)
+				{
+					const __m128 irradiance{ _mm_mul_ps(pointObservedArea, _mm_set1_ps(light.intensity)) };
+					red = _mm_add_ps(red, _mm_mul_ps(_mm_mul_ps(lambertR, irradiance), _mm_set1_ps(light.color.r)));
+					green = _mm_add_ps(green, _mm_mul_ps(_mm_mul_ps(lambertG, irradiance), _mm_set1_ps(light.color.g)));
+					blue = _mm_add_ps(blue, _mm_mul_ps(_mm_mul_ps(lambertB, irradiance), _mm_set1_ps(light.color.b)));
+				}
+				else if constexpr (colorMode == ColorMode::Specular)
+				{
+					const __m128 phong{ _mm_mul_ps(phongLobe(towardsLightX, towardsLightY, towardsLightZ), attenuation) };
+					red = _mm_add_ps(red, _mm_mul_ps(_mm_mul_ps(specularSampleR, phong), _mm_set1_ps(light.color.r)));
+					green = _mm_add_ps(green, _mm_mul_ps(_mm_mul_ps(specularSampleG, phong), _mm_set1_ps(light.color.g)));
+					blue = _mm_add_ps(blue, _mm_mul_ps(_mm_mul_ps(specularSampleB, phong), _mm_set1_ps(light.color.b)));
+				}
+				else
+				{
+					const __m128 phong{ phongLobe(towardsLightX, towardsLightY, towardsLightZ) };
+					const __m128 intensity{ _mm_set1_ps(light.intensity) };
+					const __m128 pointR{ _mm_add_ps(_mm_mul_ps(lambertR, intensity), _mm_mul_ps(specularSampleR, phong)) };
+					const __m128 pointG{ _mm_add_ps(_mm_mul_ps(lambertG, intensity), _mm_mul_ps(specularSampleG, phong)) };
+					const __m128 pointB{ _mm_add_ps(_mm_mul_ps(lambertB, intensity), _mm_mul_ps(specularSampleB, phong)) };
+					red = _mm_add_ps(red, _mm_mul_ps(_mm_mul_ps(pointR, pointObservedArea), _mm_set1_ps(light.color.r)));
+					green = _mm_add_ps(green, _mm_mul_ps(_mm_mul_ps(pointG, pointObservedArea), _mm_set1_ps(light.color.g)));
+					blue = _mm_add_ps(blue, _mm_mul_ps(_mm_mul_ps(pointB, pointObservedArea), _mm_set1_ps(light.color.b)));
+				}
+			}
+		}
+
+		_mm_store_ps(&colors[0][lane], red);
+		_mm_store_ps(&colors[1][lane], green);
+		_mm_store_ps(&colors[2][lane], blue);
 	}
-	break;
-	case dae::Renderer::ColorMode::FinalColor:
+
+	//Every covered pixel of a sample gets its color, with MSAA every covered sample of the grid
+	const int shadingRate{ tile.shadingRate };
+	const int rateShift{ std::countr_zero(static_cast<unsigned int>(shadingRate)) };
+	const int sampleWidth{ frame.pFrameBuffer->GetSampleWidth() };
+	for (int fragment{}; fragment < count; ++fragment)
 	{
-		const ColorRGB lambert{ 1.0f * m_pDiffuseMap->Sample(v.uv) / PI };
+		const ColorRGB color{ colors[0][fragment], colors[1][fragment], colors[2][fragment] };
+		for (int pixelMask{ batch.pixelMasks[fragment] }; pixelMask != 0; pixelMask &= pixelMask - 1)
+		{
+			const int pixel{ std::countr_zero(static_cast<unsigned int>(pixelMask)) };
+			frame.pFrameBuffer->WriteColor(batch.pixelIndices[fragment] + (pixel & (shadingRate - 1)) + (pixel >> rateShift) * sampleWidth, color);
+		}
+	}
+}
 
-		const float phongExponent{ m_pGlossMap->Sample(v.uv).r * glossyness };
+float Renderer::SampleShadowMap(const FrameData& frame, const Vector3& shadowPosition, float lightCosine) const
+{
+	const DepthRasterizer& shadowMap{ *frame.pShadowMap };
 
-		const ColorRGB specular{ m_pSpecularMap->Sample(v.uv) * BRDF_Utils::Phong(1.0f, phongExponent, -lightDirection, v.viewDirection, pixelNormal) };
+	//Depth changes faster between the filter texels on surfaces at a grazing angle to the light
+	const float slope{ std::min(std::sqrt(1.0f - lightCosine * lightCosine) / lightCosine, 10.0f) };
+	const float bias{ (1.0f + 1.5f * slope) / m_ShadowMapSize };
+	const float depth{ shadowPosition.z - bias };
 
-		return (lightIntensity * lambert + specular) * observedArea;
-	}
-	break;
-	default:
-		return { 1,1,1 };
+	const int centerX{ static_cast<int>(std::lround(shadowPosition.x)) };
+	const int centerY{ static_cast<int>(std::lround(shadowPosition.y)) };
+	const float* pDepthPixels{ shadowMap.GetDepthPixels() };
+
+	//Outside the map is lit
+	int nrLitSamples{};
+	for (int y{ centerY - 1 }; y <= centerY + 1; ++y)
+	{
+		for (int x{ centerX - 1 }; x <= centerX + 1; ++x)
+		{
+			if (x < 0 || y < 0 || x >= shadowMap.GetWidth() || y >= shadowMap.GetHeight() ||
+				depth <= pDepthPixels[x + y * shadowMap.GetWidth()])
+				++nrLitSamples;
+		}
 	}
+
+	return nrLitSamples / 9.0f;
 }
 
-bool Renderer::SaveBufferToImage() const
+bool Renderer::SaveBufferToImage(const std::string& path) const
 {
-	return SDL_SaveBMP(m_pBackBuffer, "Rasterizer_ColorBuffer.bmp");
+	//The present thread owns the resolved pixels, so resolve the last frame once more for the screenshot
+	if (m_pPresenter)
+	{
+		m_pPresenter->WaitForResolve();
+		m_pFrameBuffer->Resolve();
+		return SDL_SaveBMP(m_pBackBuffer, path.c_str());
+	}
+
+	//When presenting directly the last frame only exists in the window surface
+	return SDL_SaveBMP(IsPresentingDirectly() ? m_pFrontBuffer : m_pBackBuffer, path.c_str());
 }
 
 void Renderer::ToggleRenderMode()
@@ -429,6 +1737,210 @@ void Renderer::ToggleRotation()
 	m_IsRotating = !m_IsRotating;
 }
 
+void Renderer::ToggleDirectPresent()
+{
+	m_UseDirectPresent = !m_UseDirectPresent;
+}
+
+void Renderer::ToggleAsyncPresent()
+{
+	if (IsHeadless())
+		return;
+
+	//Joins the present thread, the last frame it resolved is not shown
+	if (m_pPresenter)
+	{
+		delete m_pPresenter;
+		m_pPresenter = nullptr;
+	}
+	else
+	{
+		m_pPresenter = new Presenter{ m_pWindow };
+		m_pPresenter->SetDropStaleFrames(m_DropStaleFrames);
+	}
+
+	InitFrames();
+}
+
+void Renderer::ToggleDropStaleFrames()
+{
+	m_DropStaleFrames = !m_DropStaleFrames;
+	if (m_pPresenter)
+		m_pPresenter->SetDropStaleFrames(m_DropStaleFrames);
+}
+
+uint64_t Renderer::GetNrDroppedFrames() const
+{
+	return m_pPresenter ? m_pPresenter->GetNrDroppedFrames() : 0;
+}
+
+void Renderer::ToggleReversedZ()
+{
+	m_Camera.isReversedZ = !m_Camera.isReversedZ;
+	m_Camera.CalculateProjectionMatrix();
+}
+
+void Renderer::ToggleHiZ()
+{
+	m_UseHiZ = !m_UseHiZ;
+}
+
+void Renderer::CycleDepthFormat()
+{
+	m_DepthFormat = static_cast<DepthFormat>((static_cast<int>(m_DepthFormat) + 1) % (static_cast<int>(DepthFormat::Unorm16) + 1));
+}
+
+void Renderer::SetDepthFormat(DepthFormat format)
+{
+	m_DepthFormat = format;
+}
+
+void Renderer::ToggleDepthCompression()
+{
+	m_UseDepthCompression = !m_UseDepthCompression;
+}
+
+void Renderer::ToggleInstanceGrid()
+{
+	if (m_Instances.size() > 1)
+		SetInstanceGrid(1, 1);
+	else
+		SetInstanceGrid(5, 3);
+}
+
+void Renderer::ToggleOcclusionCulling()
+{
+	m_UseOcclusionCulling = !m_UseOcclusionCulling;
+}
+
+void Renderer::ToggleFastSpecular()
+{
+	m_UseFastSpecular = !m_UseFastSpecular;
+}
+
+void Renderer::CycleShadingRatePolicy()
+{
+	SetShadingRatePolicy(static_cast<ShadingRatePolicy>((static_cast<int>(m_ShadingRatePolicy) + 1) % (static_cast<int>(ShadingRatePolicy::Adaptive) + 1)));
+}
+
+void Renderer::SetShadingRatePolicy(ShadingRatePolicy policy)
+{
+	//Gradients from before are reset by Render, the first adaptive frame is shaded at full rate
+	m_ShadingRatePolicy = policy;
+}
+
+void Renderer::SetShadingRateThresholds(float halfRateGradient, float quarterRateGradient)
+{
+	m_HalfRateGradient = halfRateGradient;
+	m_QuarterRateGradient = quarterRateGradient;
+}
+
+void Renderer::ToggleDynamicResolution()
+{
+	m_UseDynamicResolution = !m_UseDynamicResolution;
+	if (!m_UseDynamicResolution)
+	{
+		m_ResolutionScale = 1.0f;
+		m_RenderWidth = m_Width;
+		m_RenderHeight = m_Height;
+	}
+}
+
+void Renderer::SetTargetFrameTime(float milliseconds)
+{
+	m_TargetFrameTime = milliseconds;
+}
+
+void Renderer::UpdateResolutionScale(float frameTime)
+{
+	if (!m_UseDynamicResolution || frameTime <= 0.0f)
+		return;
+
+	//Frame time grows about with the number of pixels, so the scale of both sides goes with the square root
+	//Halfway towards the new scale, so a single slow frame does not make it jump
+	const float idealScale{ m_ResolutionScale * std::sqrt(m_TargetFrameTime / frameTime) };
+	m_ResolutionScale = std::clamp(m_ResolutionScale + (idealScale - m_ResolutionScale) * 0.5f, m_MinResolutionScale, 1.0f);
+
+	m_RenderWidth = std::max(static_cast<int>(m_Width * m_ResolutionScale + 0.5f), 1);
+	m_RenderHeight = std::max(static_cast<int>(m_Height * m_ResolutionScale + 0.5f), 1);
+}
+
+void Renderer::ToggleMsaa()
+{
+	m_UseMsaa = !m_UseMsaa;
+}
+
+void Renderer::ToggleFxaa()
+{
+	m_UseFxaa = !m_UseFxaa;
+}
+
+void Renderer::ToggleIncrementalRendering()
+{
+	m_UseIncrementalRendering = !m_UseIncrementalRendering;
+}
+
+void Renderer::ToggleShadows()
+{
+	m_UseShadows = !m_UseShadows;
+}
+
+void Renderer::ToggleLightCulling()
+{
+	m_UseLightCulling = !m_UseLightCulling;
+}
+
+void Renderer::ToggleLazyClear()
+{
+	m_UseLazyClear = !m_UseLazyClear;
+}
+
+void Renderer::ToggleFramePipelining()
+{
+	SetFrameLatency(m_FrameLatency > 0 ? 0 : m_MaxFrameLatency);
+}
+
+void Renderer::SetFrameLatency(int latency)
+{
+	m_FrameLatency = std::clamp(latency, 0, m_MaxFrameLatency);
+	InitFrames();
+}
+
+void Renderer::InitFrames()
+{
+	const int nrFrames{ GetNrFrames() };
+	for (int i{}; i < nrFrames; ++i)
+	{
+		if (!m_Frames[i].pFrameBuffer)
+			InitFrame(m_Frames[i]);
+	}
+
+	//A frame still in flight is finished by the next Render call, it is dropped when pipelining got disabled
+	m_NextFrame %= nrFrames;
+	if (m_pFrameInFlight == &m_Frames[m_NextFrame])
+		m_NextFrame = (m_NextFrame + 1) % (m_MaxFrameLatency + 1);
+}
+
+void Renderer::InitFrame(FrameData& frame)
+{
+	frame.pFrameBuffer = new FrameBuffer{ m_Width, m_Height };
+	InitTiles(frame);
+}
+
+void Renderer::InitTiles(FrameData& frame)
+{
+	const int width{ frame.pFrameBuffer->GetSampleWidth() };
+	const int height{ frame.pFrameBuffer->GetSampleHeight() };
+	frame.nrTilesX = (width + m_TileSize - 1) / m_TileSize;
+
+	frame.tiles.clear();
+	for (int y{}; y < height; y += m_TileSize)
+	{
+		for (int x{}; x < width; x += m_TileSize)
+			frame.tiles.push_back(Tile{ x, y, std::min(x + m_TileSize, width), std::min(y + m_TileSize, height) });
+	}
+}
+
 void Renderer::InitMesh()
 {
 
@@ -538,8 +2050,15 @@ PrimitiveTopology::TriangleList
 
 #endif // TRIANGLE_STRIP
 
-	const Vector3 position{ m_Camera.origin + Vector3{ 0, 0, 50 } };
-	const Vector3 rotation{ };
-	const Vector3 scale{ Vector3{ 1, 1, 1 } };
-	m_Mesh.worldMatrix = Matrix::CreateScale(scale) * Matrix::CreateRotation(rotation) * Matrix::CreateTranslation(position);
+	m_MeshPositions.clear();
+	m_MeshBoundsMin = m_MeshBoundsMax = m_Mesh.vertices.empty() ? Vector3{} : m_Mesh.vertices.front().position;
+	for (const Vertex& vertex : m_Mesh.vertices)
+	{
+		m_MeshPositions.push_back(vertex.position);
+		m_MeshBoundsMin = { std::min(m_MeshBoundsMin.x, vertex.position.x), std::min(m_MeshBoundsMin.y, vertex.position.y), std::min(m_MeshBoundsMin.z, vertex.position.z) };
+		m_MeshBoundsMax = { std::max(m_MeshBoundsMax.x, vertex.position.x), std::max(m_MeshBoundsMax.y, vertex.position.y), std::max(m_MeshBoundsMax.z, vertex.position.z) };
+	}
+
+	m_MeshPosition = m_Camera.origin + Vector3{ 0, 0, 50 };
+	SetInstanceGrid(1, 1);
 }
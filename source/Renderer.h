@@ -1,10 +1,14 @@
 #pragma once
 
+#include <cfloat>
 #include <cstdint>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "Camera.h"
 #include "DataTypes.h"
+#include "FrameBuffer.h"
 
 struct SDL_Window;
 struct SDL_Surface;
@@ -16,6 +20,10 @@ namespace dae
 	struct Vertex;
 	class Timer;
 	class Scene;
+	class WorkerPool;
+	class Presenter;
+	class OcclusionCuller;
+	class DepthRasterizer;
 
 	class Renderer final
 	{
@@ -33,7 +41,95 @@ namespace dae
 		};
 
 	public:
+		//How many pixels share one shading sample, coverage and depth are always per pixel
+		enum class ShadingRatePolicy
+		{
+			Full,
+			//Every tile once per 2x2 or 4x4 pixels
+			Half,
+			Quarter,
+			//Per tile, from the luminance gradient of that tile in the previous frame
+			Adaptive,
+		};
+
+		//Duration of each stage of the last Render call, in milliseconds
+		//With frame pipelining rasterization is the time spent finishing the previous frame's tiles
+		struct StageTimings
+		{
+			float clear{};
+			//Zero while the shadow map is cached
+			float shadowMap{};
+			//Testing the mesh instances against the occlusion buffer, including rasterizing the occluders
+			float occlusionCulling{};
+			//Sorting the point and spot lights into the tiles they reach
+			float lightCulling{};
+			float vertexTransform{};
+			float projection{};
+			float binning{};
+			float rasterization{};
+			//FXAA of the tiles that changed, part of rasterization
+			float postProcess{};
+			//Includes waiting for a free buffer when presenting asynchronously
+			float resolve{};
+			//Copy of the BackBuffer to the window surface, zero when presenting directly or asynchronously
+			float blit{};
+			//Only handing the frame to the present thread when presenting asynchronously
+			float present{};
+			float total{};
+		};
+
+		//Counters of the last Render call, similar to GPU pipeline statistics queries
+		struct PipelineStatistics
+		{
+			uint64_t instancesSubmitted{};
+			uint64_t instancesFrustumCulled{};
+			//Hidden behind instances closer to the camera, none of their vertices or triangles are processed
+			uint64_t instancesOccluded{};
+			//Written into the occlusion buffer, not part of trianglesSubmitted
+			uint64_t occluderTriangles{};
+			//Zero while the shadow map is cached
+			uint64_t shadowMapTriangles{};
+			uint64_t lightsSubmitted{};
+			//Point and spot lights that reach no part of the view frustum
+			uint64_t lightsCulled{};
+			//Summed over all tiles, the number of lights each tile shades with
+			uint64_t lightTileEntries{};
+			//Summed over all shaded fragments, the number of lights each fragment evaluated
+			uint64_t lightEvaluations{};
+			uint64_t inputVertices{};
+			uint64_t trianglesSubmitted{};
+			//Rejected because a vertex lies outside the frustum
+			uint64_t trianglesCulled{};
+			//Bounding box reaches past the rendered part of the framebuffer
+			uint64_t trianglesClipped{};
+			//Per sample with MSAA
+			uint64_t boundingBoxPixelsTested{};
+			uint64_t pixelsCovered{};
+			uint64_t depthTestsPassed{};
+			uint64_t depthTestsFailed{};
+			//Shading samples, one per pixel at full rate, also with MSAA
+			uint64_t shaderInvocations{};
+			//Quad samples shaded only for the derivatives of their neighbours, not part of shaderInvocations
+			uint64_t helperPixels{};
+			//Tiles with triangles that were shaded once per 2x2 or 4x4 pixels
+			uint64_t halfRateTiles{};
+			uint64_t quarterRateTiles{};
+			//Kept from the last time their framebuffer rendered them, nothing they depend on changed since
+			uint64_t tilesUnchanged{};
+			//Rejected by the coarse depth buffer, every block of the triangle was already covered by something closer
+			uint64_t hiZTrianglesRejected{};
+			uint64_t hiZBlocksRejected{};
+			//Bounding box pixels of rejected blocks, not part of boundingBoxPixelsTested
+			uint64_t hiZPixelTestsAvoided{};
+			//Depth buffer memory read and written, including clears
+			uint64_t depthBytes{};
+			//Depth test passes per framebuffer pixel
+			float overdraw{};
+		};
+
 		Renderer(SDL_Window* pWindow);
+		//Headless, renders into an in-memory framebuffer of the given size without any window
+		Renderer(int width, int height);
 		~Renderer();
 
 		Renderer(const Renderer&) = delete;
@@ -43,23 +139,275 @@ namespace dae
 
 		void Update(Timer* pTimer);
 		void Render();
+		//Depth of every instance at full resolution without culling, attributes or shading, the pass a Z-prepass would use
+		//Returns the number of triangles rasterized
+		int RenderDepthOnly();
+		//nullptr until RenderDepthOnly was called
+		const DepthRasterizer* GetDepthOnlyBuffer() const { return m_pDepthOnlyRasterizer; };
+
+		bool IsHeadless() const { return m_pWindow == nullptr; };
+		bool IsPresentingDirectly() const { return m_UseDirectPresent && m_CanPresentDirectly && !m_pPresenter; };
+		bool IsPresentingAsync() const { return m_pPresenter != nullptr; };
+		bool IsDroppingStaleFrames() const { return m_DropStaleFrames; };
+		bool IsUsingReversedZ() const { return m_Camera.isReversedZ; };
+		bool IsUsingHiZ() const { return m_UseHiZ; };
+		DepthFormat GetDepthFormat() const { return m_DepthFormat; };
+		bool IsUsingDepthCompression() const { return m_UseDepthCompression; };
+		bool IsUsingOcclusionCulling() const { return m_UseOcclusionCulling; };
+		bool IsUsingShadows() const { return m_UseShadows; };
+		bool IsUsingLightCulling() const { return m_UseLightCulling; };
+		bool IsUsingFastSpecular() const { return m_UseFastSpecular; };
+		ShadingRatePolicy GetShadingRatePolicy() const { return m_ShadingRatePolicy; };
+		bool IsUsingDynamicResolution() const { return m_UseDynamicResolution; };
+		bool IsUsingMsaa() const { return m_UseMsaa; };
+		bool IsUsingFxaa() const { return m_UseFxaa; };
+		bool IsRenderingIncrementally() const { return m_UseIncrementalRendering; };
+		//Fraction of the window width and height the next frame is rendered at
+		float GetResolutionScale() const { return m_ResolutionScale; };
+		int GetRenderWidth() const { return m_RenderWidth; };
+		int GetRenderHeight() const { return m_RenderHeight; };
+		int GetNrInstances() const { return static_cast<int>(m_Instances.size()); };
+		//Frames the present thread skipped or never got, since async presenting was enabled
+		uint64_t GetNrDroppedFrames() const;
+		bool IsClearingLazily() const { return m_UseLazyClear; };
+		int GetFrameLatency() const { return m_FrameLatency; };
+		//Last presented framebuffer
+		const FrameBuffer& GetFrameBuffer() const { return *m_pFrameBuffer; };
+		const StageTimings& GetStageTimings() const { return m_StageTimings; };
+		//Of the last presented frame
+		const PipelineStatistics& GetPipelineStatistics() const { return m_Statistics; };
+
+		//Direct control over the scene, so camera paths can be replayed deterministically
+		void SetCamera(const Vector3& origin, float pitch, float yaw);
+		void SetMeshYaw(float yaw);
+		const Camera& GetCamera() const { return m_Camera; };
+		float GetMeshYaw() const { return m_MeshYaw; };
+		//Copies of the mesh in rows behind the first one, all turning with the mesh yaw
+		void SetInstanceGrid(int nrColumns, int nrRows);
+		//Direction the directional light shines in
+		void SetLightDirection(const Vector3& direction);
+		const Vector3& GetLightDirection() const { return m_LightDirection; };
+		//Point and spot lights on top of the directional light, returns the index of the new light
+		int AddLight(const Light& light);
+		void ClearLights();
+		const std::vector<Light>& GetLights() const { return m_Lights; };
+		//Replaces the lights with nrLights colored point and spot lights spread over the instances, the same layout every call
+		void ScatterLights(int nrLights);
 
+		void SetShadingRatePolicy(ShadingRatePolicy policy);
+		//Adaptive policy: tiles whose mean luminance difference between neighbouring 2x2 or 4x4 shading samples is below these are shaded at that rate
+		void SetShadingRateThresholds(float halfRateGradient, float quarterRateGradient);
 
-		bool SaveBufferToImage() const;
+		//Dynamic resolution picks the render size of every frame to reach this frame time, and scales the image up to the window
+		void SetTargetFrameTime(float milliseconds);
+		float GetTargetFrameTime() const { return m_TargetFrameTime; };
+		//Steers the dynamic resolution, Update passes the Timer's elapsed time
+		void UpdateResolutionScale(float frameTime);
+
+		//0 renders and presents every frame within its Render call
+		//1 rasterizes the frame in the background while the next Render call transforms the next frame and presents this one
+		//Nothing higher, the worker pool rasterizes one frame at a time so a second frame in flight would only wait. Clamped to the supported range
+		void SetFrameLatency(int latency);
+		static int GetMaxFrameLatency() { return m_MaxFrameLatency; };
+
+		bool SaveBufferToImage(const std::string& path = "Rasterizer_ColorBuffer.bmp") const;
 
 		void ToggleRenderMode();
 		void ToggleColorMode();
 		void ToggleNormals();
 		void ToggleRotation();
+		void ToggleDirectPresent();
+		void ToggleLazyClear();
+		void ToggleFramePipelining();
+		//Resolve on the present thread, the window shows each frame at the end of the next Render call
+		void ToggleAsyncPresent();
+		void ToggleDropStaleFrames();
+		void ToggleReversedZ();
+		void ToggleHiZ();
+		void CycleDepthFormat();
+		void SetDepthFormat(DepthFormat format);
+		void ToggleDepthCompression();
+		void ToggleInstanceGrid();
+		void ToggleOcclusionCulling();
+		void ToggleShadows();
+		void ToggleLightCulling();
+		void ToggleFastSpecular();
+		void CycleShadingRatePolicy();
+		void ToggleDynamicResolution();
+		void ToggleMsaa();
+		void ToggleFxaa();
+		void ToggleIncrementalRendering();
 
 	private:
+		struct MeshInstance
+		{
+			Vector3 offset{};
+			Matrix worldMatrix{};
+		};
+
+		//Triangle that survived culling, with its bounding box clamped to the framebuffer
+		//The indices point into the frame's vertices, which hold every visible instance
+		struct BinnedTriangle
+		{
+			int i0{};
+			int i1{};
+			int i2{};
+			int startX{};
+			int startY{};
+			int endX{};
+			int endY{};
+		};
+
+		//Mean luminance difference between neighbouring shading samples of a tile at 2x2 and 4x4 rate
+		//Measured on the samples that were shaded, so a coarse tile reads the same detail it would at full rate
+		struct TileGradient
+		{
+			float halfRate{ FLT_MAX };
+			float quarterRate{ FLT_MAX };
+			//In pixels, of the tile that measured them
+			int shadingRate{ 1 };
+		};
+
+		//Fragments of one triangle that passed the depth test, shaded together with every attribute in its own array
+		struct FragmentBatch
+		{
+			static constexpr int Size{ 8 };
+
+			//Two 2x2 quads of shading samples, lanes 0 and 1 are the top row of a quad and lanes 2 and 3 the bottom row
+			int count{};
+			//Filled up to count, the arrays are not initialized
+			//Top left pixel of the shading rate x shading rate pixels of the sample
+			int pixelIndices[Size];
+			//One bit per pixel of the sample that passed coverage and depth, row by row
+			//Samples without any are helpers that are shaded but not written
+			int pixelMasks[Size];
+			//Screen space barycentric weights of the triangle's three vertices
+			alignas(16) float weights[3][Size];
+
+			alignas(16) float normals[3][Size];
+			alignas(16) float tangents[3][Size];
+			alignas(16) float uvs[2][Size];
+			//Screen space uv derivatives per pixel, shared by the samples of a quad row (ddx) or column (ddy)
+			alignas(16) float uvDdx[2][Size];
+			alignas(16) float uvDdy[2][Size];
+			alignas(16) float viewDirections[3][Size];
+			alignas(16) float shadowPositions[3][Size];
+			alignas(16) float worldPositions[3][Size];
+		};
+
+		//Screen region rasterized by one worker job, with the triangles overlapping it in submission order
+		struct Tile
+		{
+			int x0{};
+			int y0{};
+			int x1{};
+			int y1{};
+			std::vector<uint32_t> triangles{};
+			//Indices into the frame's lights, only these are evaluated for the tile's pixels
+			std::vector<uint32_t> lights{};
+			//Pixels per side of one shading sample: 1, 2 or 4
+			int shadingRate{ 1 };
+
+			//Hash of the instances binned into the tile, in binning order
+			uint64_t instancesKey{};
+			uint64_t lastInstanceKey{};
+			//Hash of everything the tile's pixels depend on, as last rendered into the frame's framebuffer
+			uint64_t renderedKey{};
+			//The framebuffer already holds this frame's content for the tile
+			bool isUnchanged{};
+		};
+
+		//Light as the shading loop uses it
+		struct FrameLight
+		{
+			Vector3 position{};
+			//Reversed cone axis, compared with the direction from the lit point to the light
+			Vector3 spotDirection{};
+			ColorRGB color{};
+			float intensity{};
+			float inverseRadiusSquared{};
+			bool isSpot{};
+			float cosOuterCone{};
+			float inverseConeRange{};
+		};
+
+		struct FrameData;
+		//Rasterizes and shades one tile, compiled once for every combination of the options the pixel loop depends on
+		using TileKernel = void (Renderer::*)(const FrameData& frame, const Tile& tile, PipelineStatistics& statistics);
+
+		//Everything a frame needs after the vertex stage, double-buffered so the next frame can be prepared while this one is rasterized
+		struct FrameData
+		{
+			FrameBuffer* pFrameBuffer{ nullptr };
+			//Rendered part of the framebuffer's sample grid, smaller than it with dynamic resolution
+			int width{};
+			int height{};
+			//Twice as many samples per row and column with MSAA, the tiles are laid out over the sample grid
+			int samplesPerSide{ 1 };
+			int nrTilesX{};
+			//Only single sampled frames are filtered, MSAA already smooths their edges
+			bool useFxaa{};
+			std::vector<Vertex_Out> vertices{};
+			std::vector<Vector2> screenVertices{};
+			std::vector<BinnedTriangle> triangles{};
+			std::vector<Tile> tiles{};
+			//Point and spot lights that reach the view frustum
+			std::vector<FrameLight> lights{};
+			PipelineStatistics statistics{};
+
+			//Copied per frame, so toggling them does not affect a frame that is still being rasterized
+			RenderMode renderMode{};
+			ColorMode colorMode{};
+			bool useNormalMap{};
+			bool useLazyClear{};
+			bool isReversedZ{};
+			bool useHiZ{};
+			//Farthest possible depth, 0 with reversed-Z
+			float depthClearValue{};
+			bool useShadows{};
+			bool useFastSpecular{};
+			ShadingRatePolicy shadingRatePolicy{};
+
+			//Camera, settings and lights, everything besides the instances that the image depends on
+			uint64_t sceneKey{};
+			//World matrices of all instances, they also decide the shadows
+			uint64_t instancesKey{};
+			//Of the last frame rendered into this framebuffer
+			uint64_t renderedSceneKey{};
+			uint64_t renderedInstancesKey{};
+			//Selected from the render mode, color mode and normal map setting above
+			TileKernel tileKernel{ nullptr };
+
+			//Each frame keeps its own copy, so the shadow map can be updated while the other frame is still rasterized
+			DepthRasterizer* pShadowMap{ nullptr };
+			uint64_t shadowMapVersion{};
+			//World space => light clip space
+			Matrix shadowMatrix{};
+		};
+
+		static constexpr int m_TileSize{ 64 };
+		static constexpr int m_MaxFrameLatency{ 1 };
+		//Framebuffer pixels per occlusion buffer pixel, in both directions
+		static constexpr int m_OcclusionDownscale{ 4 };
+		static constexpr int m_ShadowMapSize{ 1024 };
+
 		SDL_Window* m_pWindow{};
 
+		FrameBuffer* m_pFrameBuffer{ nullptr };
+
+		//One more than the frame latency needs while the present thread resolves the last presented frame
+		FrameData m_Frames[m_MaxFrameLatency + 2]{};
+		int m_FrameLatency{ 0 };
+		int m_NextFrame{};
+		FrameData* m_pFrameInFlight{ nullptr };
+
 		SDL_Surface* m_pFrontBuffer{ nullptr };
+		PackedPixelFormat m_FrontBufferFormat{};
+		bool m_CanPresentDirectly{ false };
+		bool m_UseDirectPresent{ true };
 		SDL_Surface* m_pBackBuffer{ nullptr };
-		uint32_t* m_pBackBufferPixels{};
-
-		float* m_pDepthBufferPixels{};
+		Presenter* m_pPresenter{ nullptr };
+		bool m_DropStaleFrames{ false };
 
 		Texture* m_pDiffuseMap{ nullptr };
 		Texture* m_pNormalMap{ nullptr };
@@ -69,24 +417,123 @@ namespace dae
 		Camera m_Camera{};
 
 		Mesh m_Mesh{};
+		//Smallest vertex format, for the depth only passes
+		std::vector<Vector3> m_MeshPositions{};
+		Vector3 m_MeshPosition{};
+		float m_MeshYaw{};
+		//Object space bounding box, tested against the occlusion buffer
+		Vector3 m_MeshBoundsMin{};
+		Vector3 m_MeshBoundsMax{};
+
+		std::vector<MeshInstance> m_Instances{};
+		//Of the frame being prepared, front to back when culling
+		std::vector<int> m_VisibleInstances{};
+		std::vector<std::pair<float, int>> m_SortedInstances{};
+		OcclusionCuller* m_pOcclusionCuller{ nullptr };
+		DepthRasterizer* m_pDepthOnlyRasterizer{ nullptr };
+
+		Vector3 m_LightDirection{ Vector3{ .577f, -.577f, .577f }.Normalized() };
+		std::vector<Light> m_Lights{};
+		//Only list a light in the tiles its sphere projects onto, instead of in every tile
+		bool m_UseLightCulling{ true };
+		bool m_UseShadows{ true };
+		//Polynomial exp2/log2 instead of powf for the specular exponent
+		bool m_UseFastSpecular{ true };
+		//Bumped whenever the instances or the light change, frames with an older shadow map render it again
+		uint64_t m_ShadowMapVersion{ 1 };
+		bool m_UseOcclusionCulling{ true };
+
+		ShadingRatePolicy m_ShadingRatePolicy{ ShadingRatePolicy::Full };
+		float m_HalfRateGradient{ 0.04f };
+		float m_QuarterRateGradient{ 0.015f };
+		//Written by the tiles of the last rasterized frame, sized for the tiles of a multisampled frame
+		std::vector<TileGradient> m_TileGradients{};
+		//Whether the last started frame writes the gradients, and the sample grid its tiles are laid out over
+		bool m_AreTileGradientsWritten{ false };
+		int m_TileGradientsSamplesPerSide{ 1 };
 
 		int m_Width{};
 		int m_Height{};
 
+		bool m_UseDynamicResolution{ false };
+		float m_TargetFrameTime{ 33.3f };
+		float m_MinResolutionScale{ 0.5f };
+		float m_ResolutionScale{ 1.0f };
+		int m_RenderWidth{};
+		int m_RenderHeight{};
+
+		//Only re-render tiles whose content can have changed since their framebuffer last held them, needs lazy clears
+		bool m_UseIncrementalRendering{ true };
+
+		//4 depth tested samples per pixel, shaded once per pixel and triangle
+		bool m_UseMsaa{ false };
+		//Image space anti-aliasing of the finished tiles, a fixed cost per pixel
+		bool m_UseFxaa{ false };
+
 		bool m_UseNormalMap{ true };
 		bool m_IsRotating{ true };
+		//Clear every tile right before it is rasterized instead of the whole framebuffer up front
+		bool m_UseLazyClear{ true };
+		//Skip 8x8 blocks whose farthest depth is closer than the triangle
+		bool m_UseHiZ{ true };
+		DepthFormat m_DepthFormat{ DepthFormat::Float32 };
+		//Blocks that are cleared or covered by one triangle keep only a plane instead of depth pixels
+		bool m_UseDepthCompression{ true };
+
+		WorkerPool* m_pWorkerPool{ nullptr };
+		std::vector<PipelineStatistics> m_WorkerStatistics{};
+
+		RenderMode m_CurrentRenderMode{};
+		ColorMode m_CurrentColorMode{};
+
+		StageTimings m_StageTimings{};
+		PipelineStatistics m_Statistics{};
+		float m_MillisecondsPerCount{};
+
+		void Initialize();
 
-		RenderMode m_CurrentRenderMode;
-		ColorMode m_CurrentColorMode;
+		//Fills m_VisibleInstances, the occluders are rasterized on the calling thread
+		void CullInstances(FrameData& frame);
+		//Only renders when the shadow map of the frame is outdated, returns false when it was cached
+		bool UpdateShadowMap(FrameData& frame);
+		//Fills the frame's lights and the light lists of its tiles
+		void CullLights(FrameData& frame);
+		//Shading rate of every tile from the policy, the previous frame has to be finished
+		void SelectShadingRates(FrameData& frame);
 
 		//Function that transforms the vertices from the mesh from World space to Screen space
-		void VertexTransformationFunction(); //W1 Version
+		void VertexTransformationFunction(FrameData& frame); //W1 Version
 
-		void RenderTraingle(int i0, int i1, int i2, std::vector<Vector2>& screenVertices);
+		//Hash of the settings, camera and lights the image depends on
+		uint64_t CalculateSceneKey(const FrameData& frame) const;
+		//instanceKey is the hash of the triangle's instance, it is added to the keys of the tiles the triangle overlaps
+		void BinTriangle(FrameData& frame, int i0, int i1, int i2, uint64_t instanceKey);
+		//Marks the tiles whose framebuffer region already holds this frame's content
+		void UpdateTileKeys(FrameData& frame);
+		void StartRasterization(FrameData& frame);
+		void FinishRasterization(FrameData& frame);
+		//Filters the tiles that changed and their neighbours, whose edges can reach into them
+		void ApplyFxaa(FrameData& frame);
+		static TileKernel SelectTileKernel(RenderMode renderMode, ColorMode colorMode, bool useNormalMap);
+		template<RenderMode renderMode, ColorMode colorMode, bool useNormalMap>
+		void RenderTile(const FrameData& frame, const Tile& tile, PipelineStatistics& statistics);
+		template<RenderMode renderMode, ColorMode colorMode, bool useNormalMap>
+		void RenderTraingle(const FrameData& frame, const BinnedTriangle& triangle, const Tile& tile, PipelineStatistics& statistics);
+		int GetNrFrames() const { return m_FrameLatency + (m_pPresenter ? 2 : 1); };
+		//Allocates the frames GetNrFrames rotates through, and keeps the next one off the frame in flight
+		void InitFrames();
+		void InitFrame(FrameData& frame);
+		//Lays the tiles out over the sample grid of the frame's framebuffer
+		void InitTiles(FrameData& frame);
 		void InitMesh();
+		void UpdateMeshWorldMatrix();
 		bool PositionOutsideFrustrum(const Vector4& v);
 
-		ColorRGB PixelShading(const Vertex_Out& v);
+		//Interpolates the attributes of every fragment in the batch, shades them and writes their colors, leaves the batch empty
+		template<ColorMode colorMode, bool useNormalMap>
+		void ShadeFragments(const FrameData& frame, const BinnedTriangle& triangle, const Tile& tile, FragmentBatch& batch) const;
+		//Fraction of the 3x3 filter that sees the light
+		float SampleShadowMap(const FrameData& frame, const Vector3& shadowPosition, float lightCosine) const;
 
 	};
 }
@@ -0,0 +1,78 @@
+#pragma once
+#include <cfloat>
+#include <emmintrin.h>
+
+namespace dae
+{
+	//Four lane versions of the scalar math helpers, every lane gives the same result as the scalar function
+
+	inline __m128 Dot(__m128 x0, __m128 y0, __m128 z0, __m128 x1, __m128 y1, __m128 z1)
+	{
+		return _mm_add_ps(_mm_add_ps(_mm_mul_ps(x0, x1), _mm_mul_ps(y0, y1)), _mm_mul_ps(z0, z1));
+	}
+
+	//Same as Vector3::Normalize
+	inline void Normalize(__m128& x, __m128& y, __m128& z)
+	{
+		const __m128 magnitude{ _mm_sqrt_ps(Dot(x, y, z, x, y, z)) };
+		x = _mm_div_ps(x, magnitude);
+		y = _mm_div_ps(y, magnitude);
+		z = _mm_div_ps(z, magnitude);
+	}
+
+	//See the scalar FastLog2 in MathHelpers.h
+	inline __m128 FastLog2(__m128 x)
+	{
+		const __m128i bits{ _mm_castps_si128(x) };
+		const __m128 exponent{ _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127))) };
+		const __m128 mantissa{ _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)), _mm_set1_epi32(0x3F800000))) };
+
+		const __m128 mantissa2{ _mm_mul_ps(mantissa, mantissa) };
+		const __m128 term0{ _mm_sub_ps(_mm_set1_ps(3.1157899f), _mm_mul_ps(_mm_set1_ps(3.3241990f), mantissa)) };
+		const __m128 term1{ _mm_sub_ps(_mm_set1_ps(2.5988452f), _mm_mul_ps(_mm_set1_ps(1.2315303f), mantissa)) };
+		const __m128 term2{ _mm_sub_ps(_mm_set1_ps(3.1821337e-1f), _mm_mul_ps(_mm_set1_ps(3.4436006e-2f), mantissa)) };
+		const __m128 polynomial{ _mm_add_ps(_mm_add_ps(term0, _mm_mul_ps(term1, mantissa2)), _mm_mul_ps(_mm_mul_ps(term2, mantissa2), mantissa2)) };
+
+		return _mm_add_ps(_mm_mul_ps(polynomial, _mm_sub_ps(mantissa, _mm_set1_ps(1.0f))), exponent);
+	}
+
+	//See the scalar FastExp2 in MathHelpers.h
+	inline __m128 FastExp2(__m128 x)
+	{
+		x = _mm_max_ps(x, _mm_set1_ps(-126.0f));
+
+		//Floor without SSE4.1, truncation rounds negative values up so those are stepped back down
+		__m128 integer{ _mm_cvtepi32_ps(_mm_cvttps_epi32(x)) };
+		integer = _mm_sub_ps(integer, _mm_and_ps(_mm_cmpgt_ps(integer, x), _mm_set1_ps(1.0f)));
+		const __m128 fraction{ _mm_sub_ps(x, integer) };
+
+		const __m128 fraction2{ _mm_mul_ps(fraction, fraction) };
+		const __m128 term0{ _mm_add_ps(_mm_set1_ps(9.9999994e-1f), _mm_mul_ps(_mm_set1_ps(6.9315308e-1f), fraction)) };
+		const __m128 term1{ _mm_add_ps(_mm_set1_ps(2.4015361e-1f), _mm_mul_ps(_mm_set1_ps(5.5826318e-2f), fraction)) };
+		const __m128 term2{ _mm_add_ps(_mm_set1_ps(8.9893397e-3f), _mm_mul_ps(_mm_set1_ps(1.8775767e-3f), fraction)) };
+		const __m128 polynomial{ _mm_add_ps(_mm_add_ps(term0, _mm_mul_ps(term1, fraction2)), _mm_mul_ps(_mm_mul_ps(term2, fraction2), fraction2)) };
+
+		const __m128i scaleBits{ _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(integer), _mm_set1_epi32(127)), 23) };
+		return _mm_mul_ps(polynomial, _mm_castsi128_ps(scaleBits));
+	}
+
+	//See the scalar FastPow in MathHelpers.h
+	inline __m128 FastPow(__m128 base, __m128 exponent)
+	{
+		const __m128 result{ FastExp2(_mm_mul_ps(exponent, FastLog2(_mm_max_ps(base, _mm_set1_ps(FLT_MIN))))) };
+		const __m128 isDefined{ _mm_or_ps(_mm_cmpgt_ps(base, _mm_setzero_ps()), _mm_cmpeq_ps(exponent, _mm_setzero_ps())) };
+		return _mm_and_ps(result, isDefined);
+	}
+
+	//Derivatives across a 2x2 quad in lanes (0, 1, 2, 3) = (top left, top right, bottom left, bottom right)
+	//Every lane gets the difference along its own row or column, like the fine derivatives of a GPU
+	inline __m128 QuadDdx(__m128 v)
+	{
+		return _mm_sub_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 1, 1)), _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 0, 0)));
+	}
+
+	inline __m128 QuadDdy(__m128 v)
+	{
+		return _mm_sub_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 2, 3, 2)), _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 1, 0)));
+	}
+}
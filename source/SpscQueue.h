@@ -0,0 +1,48 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+namespace dae
+{
+	//Lock-free ring buffer for exactly one producer thread and one consumer thread
+	template<typename T, size_t Capacity>
+	class SpscQueue final
+	{
+	public:
+		//Producer only, returns false when the queue is full
+		bool Push(const T& value)
+		{
+			const size_t tail{ m_Tail.load(std::memory_order_relaxed) };
+			if (tail - m_Head.load(std::memory_order_acquire) == Capacity)
+				return false;
+
+			m_Items[tail % Capacity] = value;
+			m_Tail.store(tail + 1, std::memory_order_release);
+			return true;
+		}
+
+		//Consumer only, returns false when the queue is empty
+		bool Pop(T& value)
+		{
+			const size_t head{ m_Head.load(std::memory_order_relaxed) };
+			if (head == m_Tail.load(std::memory_order_acquire))
+				return false;
+
+			value = m_Items[head % Capacity];
+			m_Head.store(head + 1, std::memory_order_release);
+			return true;
+		}
+
+		bool IsEmpty() const
+		{
+			return m_Head.load(std::memory_order_acquire) == m_Tail.load(std::memory_order_acquire);
+		}
+
+	private:
+		T m_Items[Capacity]{};
+
+		//Separate cache lines, so producer and consumer do not invalidate each other on every access
+		alignas(64) std::atomic<size_t> m_Head{};
+		alignas(64) std::atomic<size_t> m_Tail{};
+	};
+}
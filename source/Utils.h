@@ -184,5 +184,15 @@ namespace dae
 
 			return ColorRGB{ phong, phong, phong };
 		}
+
+		//Same as Phong with FastPow instead of powf
+		inline ColorRGB PhongFast(float ks, float exp, const Vector3& l, const Vector3& v, const Vector3& n)
+		{
+			const Vector3 reflectedLightVector{ Vector3::Reflect(l,n) };
+			const float reflectedViewDot{ std::max(Vector3::Dot(reflectedLightVector, v), 0.f) };
+			const float phong{ ks * FastPow(reflectedViewDot, exp) };
+
+			return ColorRGB{ phong, phong, phong };
+		}
 	}
 }
\ No newline at end of file
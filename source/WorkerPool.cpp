@@ -0,0 +1,80 @@
+#include "WorkerPool.h"
+#include "Profiler.h"
+#include <string>
+
+namespace dae
+{
+	WorkerPool::WorkerPool(int nrThreads)
+	{
+		m_Threads.reserve(nrThreads);
+		for (int i{}; i < nrThreads; ++i)
+			m_Threads.emplace_back(&WorkerPool::ThreadLoop, this, i + 1);
+	}
+
+	WorkerPool::~WorkerPool()
+	{
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_IsStopping = true;
+		}
+		m_StartCondition.notify_all();
+
+		for (std::thread& thread : m_Threads)
+			thread.join();
+	}
+
+	void WorkerPool::Dispatch(int nrJobs, const Job& job)
+	{
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_Job = job;
+			m_NrJobs = nrJobs;
+			m_NextJob = 0;
+			m_NrBusyThreads = static_cast<int>(m_Threads.size());
+			++m_Batch;
+		}
+		m_StartCondition.notify_all();
+	}
+
+	void WorkerPool::Wait()
+	{
+		ExecuteJobs(0);
+
+		std::unique_lock lock{ m_Mutex };
+		m_DoneCondition.wait(lock, [this] { return m_NrBusyThreads == 0; });
+	}
+
+	void WorkerPool::ThreadLoop(int workerIndex)
+	{
+		PROFILE_THREAD_NAME("Worker " + std::to_string(workerIndex));
+
+		uint64_t lastBatch{};
+		while (true)
+		{
+			{
+				std::unique_lock lock{ m_Mutex };
+				m_StartCondition.wait(lock, [&] { return m_IsStopping || m_Batch != lastBatch; });
+
+				if (m_IsStopping)
+					return;
+
+				lastBatch = m_Batch;
+			}
+
+			ExecuteJobs(workerIndex);
+
+			{
+				std::lock_guard lock{ m_Mutex };
+				--m_NrBusyThreads;
+			}
+			m_DoneCondition.notify_one();
+		}
+	}
+
+	void WorkerPool::ExecuteJobs(int workerIndex)
+	{
+		//Jobs are handed out one at a time, so threads that finish early take over the rest
+		for (int jobIndex{ m_NextJob++ }; jobIndex < m_NrJobs; jobIndex = m_NextJob++)
+			m_Job(jobIndex, workerIndex);
+	}
+}
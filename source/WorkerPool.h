@@ -0,0 +1,59 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dae
+{
+	//Persistent worker threads that execute a batch of indexed jobs, used for the tile rasterizer
+	class WorkerPool final
+	{
+	public:
+		//Job(jobIndex, workerIndex), worker index 0 is the thread that waits on the batch
+		using Job = std::function<void(int, int)>;
+
+		explicit WorkerPool(int nrThreads);
+		~WorkerPool();
+
+		WorkerPool(const WorkerPool&) = delete;
+		WorkerPool(WorkerPool&&) noexcept = delete;
+		WorkerPool& operator=(const WorkerPool&) = delete;
+		WorkerPool& operator=(WorkerPool&&) noexcept = delete;
+
+		//Background threads + the waiting thread
+		int GetNrWorkers() const { return static_cast<int>(m_Threads.size()) + 1; };
+
+		//Starts the batch on the background threads and returns immediately
+		void Dispatch(int nrJobs, const Job& job);
+		//Helps with the remaining jobs of the batch and returns when all of them are done
+		void Wait();
+
+		void Run(int nrJobs, const Job& job)
+		{
+			Dispatch(nrJobs, job);
+			Wait();
+		}
+
+	private:
+		std::vector<std::thread> m_Threads{};
+
+		std::mutex m_Mutex{};
+		std::condition_variable m_StartCondition{};
+		std::condition_variable m_DoneCondition{};
+
+		Job m_Job{};
+		int m_NrJobs{};
+		uint64_t m_Batch{};
+		int m_NrBusyThreads{};
+		bool m_IsStopping{ false };
+
+		std::atomic<int> m_NextJob{};
+
+		void ThreadLoop(int workerIndex);
+		void ExecuteJobs(int workerIndex);
+	};
+}
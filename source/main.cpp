@@ -6,24 +6,93 @@
 
 //Standard includes
 #include <iostream>
+#include <sstream>
+#include <string>
 
 //Project includes
 #include "Timer.h"
 #include "Renderer.h"
+#include "CameraPath.h"
+#include "Profiler.h"
 
 using namespace dae;
 
+void SaveProfile()
+{
+#ifdef RASTERIZER_PROFILE
+	if (PROFILE_SAVE("Rasterizer_Trace.json"))
+		std::cout << "Profile saved! Open Rasterizer_Trace.json in chrome://tracing" << std::endl;
+	else
+		std::cout << "Something went wrong. Profile not saved!" << std::endl;
+#endif
+}
+
 void ShutDown(SDL_Window* pWindow)
 {
 	SDL_DestroyWindow(pWindow);
 	SDL_Quit();
 }
 
+//Parses a strictly positive integer, rejecting trailing characters
+bool ParsePositiveInt(const char* pText, int& value)
+{
+	std::istringstream stream{ pText };
+	char trailing{};
+	return (stream >> value) && !(stream >> trailing) && value > 0;
+}
+
+//Renders a batch of frames into an in-memory framebuffer, no display or SDL video needed
+int RunHeadless(int width, int height, int nrFrames)
+{
+	const auto pTimer = new Timer();
+	const auto pRenderer = new Renderer(width, height);
+
+	pTimer->Start();
+	for (int frame{}; frame < nrFrames; ++frame)
+	{
+		pRenderer->Update(pTimer);
+		pRenderer->Render();
+		pTimer->Update();
+	}
+	pTimer->Stop();
+
+	SaveProfile();
+
+	std::cout << "Rendered " << nrFrames << " frames at " << width << "x" << height << std::endl;
+
+	int result{ 0 };
+	if (pRenderer->SaveBufferToImage())
+	{
+		std::cout << "Something went wrong. Screenshot not saved!" << std::endl;
+		result = 1;
+	}
+
+	delete pRenderer;
+	delete pTimer;
+	return result;
+}
+
 int main(int argc, char* args[])
 {
-	//Unreferenced parameters
-	(void)argc;
-	(void)args;
+	//Usage: Rasterizer.exe --headless [width height [frames]]
+	if (argc > 1 && std::string{ args[1] } == "--headless")
+	{
+		int width{ 640 };
+		int height{ 480 };
+		int nrFrames{ 1 };
+		if (argc > 3 && (!ParsePositiveInt(args[2], width) || !ParsePositiveInt(args[3], height)))
+		{
+			std::cout << "Invalid resolution: " << args[2] << " " << args[3] << std::endl;
+			return 1;
+		}
+		if (argc > 4 && !ParsePositiveInt(args[4], nrFrames))
+		{
+			std::cout << "Invalid frame count: " << args[4] << std::endl;
+			return 1;
+		}
+
+		return RunHeadless(width, height, nrFrames);
+	}
 
 	//Create window + surfaces
 	SDL_Init(SDL_INIT_VIDEO);
@@ -49,6 +118,14 @@ int main(int argc, char* args[])
 	float printTimer = 0.f;
 	bool isLooping = true;
 	bool takeScreenshot = false;
+	bool printStatistics = false;
+
+	//Camera path recording for the benchmark (F9 to start/stop)
+	CameraPath recordedPath{};
+	bool isRecording = false;
+	float recordTime = 0.f;
+	float recordKeyTimer = 0.f;
+	const float recordKeyInterval = 0.1f;
 	while (isLooping)
 	{
 		//--------- Get input events ---------
@@ -63,6 +140,86 @@ int main(int argc, char* args[])
 			case SDL_KEYUP:
 				if (e.key.keysym.scancode == SDL_SCANCODE_X)
 					takeScreenshot = true;
+				else if (e.key.keysym.scancode == SDL_SCANCODE_H)
+				{
+					pRenderer->ToggleHiZ();
+					std::cout << "Hierarchical Z: " << (pRenderer->IsUsingHiZ() ? "on" : "off") << std::endl;
+				}
+				else if (e.key.keysym.scancode == SDL_SCANCODE_B)
+				{
+					pRenderer->CycleDepthFormat();
+					const char* formatNames[]{ "32 bit float", "24 bit unorm", "16 bit unorm" };
+					std::cout << "Depth format: " << formatNames[static_cast<int>(pRenderer->GetDepthFormat())] << std::endl;
+				}
+				else if (e.key.keysym.scancode == SDL_SCANCODE_C)
+				{
+					pRenderer->ToggleDepthCompression();
+					std::cout << "Depth compression: " << (pRenderer->IsUsingDepthCompression() ? "on" : "off") << std::endl;
+				}
+				else if (e.key.keysym.scancode == SDL_SCANCODE_G)
+				{
+					pRenderer->ToggleInstanceGrid();
+					std::cout << "Instances: " << pRenderer->GetNrInstances() << std::endl;
+				}
+				else if (e.key.keysym.scancode == SDL_SCANCODE_O)
+				{
+					pRenderer->ToggleOcclusionCulling();
+					std::cout << "Occlusion culling: " << (pRenderer->IsUsingOcclusionCulling() ? "on" : "off") << std::endl;
+				}
+				else if (e.key.keysym.scancode == SDL_SCANCODE_L)
+				{
+					pRenderer->ToggleShadows();
+					std::cout << "Shadows: " << (pRenderer->IsUsingShadows() ? "on" : "off") << std::endl;
+				}
+				else if (e.key.keysym.scancode == SDL_SCANCODE_K)
+				{
+					//0 => 16 => 128 => 512 point and spot lights
+					const size_t nrLights{ pRenderer->GetLights().size() };
+					pRenderer->ScatterLights(nrLights == 0 ? 16 : nrLights == 16 ? 128 : nrLights == 128 ? 512 : 0);
+					std::cout << "Lights: " << pRenderer->GetLights().size() << std::endl;
+				}
+				else if (e.key.keysym.scancode == SDL_SCANCODE_J)
+				{
+					pRenderer->ToggleLightCulling();
+					std::cout << "Light culling: " << (pRenderer->IsUsingLightCulling() ? "per tile" : "off, every light in every tile") << std::endl;
+				}
+				else if (e.key.keysym.scancode == SDL_SCANCODE_P)
+				{
+					pRenderer->ToggleFastSpecular();
+					std::cout << "Specular pow: " << (pRenderer->IsUsingFastSpecular() ? "polynomial" : "powf") << std::endl;
+				}
+				else if (e.key.keysym.scancode == SDL_SCANCODE_V)
+				{
+					pRenderer->CycleShadingRatePolicy();
+					const char* policyNames[]{ "full", "2x2", "4x4", "adaptive (luminance gradient of the last frame)" };
+					std::cout << "Shading rate: " << policyNames[static_cast<int>(pRenderer->GetShadingRatePolicy())] << std::endl;
+				}
+				else if (e.key.keysym.scancode == SDL_SCANCODE_R)
+				{
+					pRenderer->ToggleDynamicResolution();
+					std::cout << "Dynamic resolution: " << (pRenderer->IsUsingDynamicResolution() ? "on" : "off")
+						<< " (target " << pRenderer->GetTargetFrameTime() << " ms)" << std::endl;
+				}
+				else if (e.key.keysym.scancode == SDL_SCANCODE_M)
+				{
+					pRenderer->ToggleMsaa();
+					std::cout << "MSAA: " << (pRenderer->IsUsingMsaa() ? "4x" : "off") << std::endl;
+				}
+				else if (e.key.keysym.scancode == SDL_SCANCODE_F)
+				{
+					pRenderer->ToggleFxaa();
+					std::cout << "FXAA: " << (pRenderer->IsUsingFxaa() ? "on" : "off") << (pRenderer->IsUsingMsaa() ? " (not with MSAA)" : "") << std::endl;
+				}
+				else if (e.key.keysym.scancode == SDL_SCANCODE_I)
+				{
+					pRenderer->ToggleIncrementalRendering();
+					std::cout << "Incremental rendering: " << (pRenderer->IsRenderingIncrementally() ? "on" : "off") << std::endl;
+				}
+				else if (e.key.keysym.scancode == SDL_SCANCODE_Z)
+				{
+					pRenderer->ToggleReversedZ();
+					std::cout << "Depth: " << (pRenderer->IsUsingReversedZ() ? "reversed-Z" : "regular") << std::endl;
+				}
 				else if (e.key.keysym.scancode == SDL_SCANCODE_F3)
 					pRenderer->ToggleRenderMode();
 				else if (e.key.keysym.scancode == SDL_SCANCODE_F6)
@@ -71,6 +228,50 @@ int main(int argc, char* args[])
 					pRenderer->ToggleRotation();
 				else if (e.key.keysym.scancode == SDL_SCANCODE_F7)
 					pRenderer->ToggleColorMode();
+				else if (e.key.keysym.scancode == SDL_SCANCODE_F4)
+				{
+					pRenderer->ToggleDirectPresent();
+					std::cout << "Present: " << (pRenderer->IsPresentingDirectly() ? "direct to window surface" : "blit from BackBuffer") << std::endl;
+				}
+				else if (e.key.keysym.scancode == SDL_SCANCODE_F11)
+				{
+					pRenderer->ToggleAsyncPresent();
+					std::cout << "Present: " << (pRenderer->IsPresentingAsync() ? "resolved on present thread" : "on render thread") << std::endl;
+				}
+				else if (e.key.keysym.scancode == SDL_SCANCODE_F12)
+				{
+					pRenderer->ToggleDropStaleFrames();
+					std::cout << "Stale frames: " << (pRenderer->IsDroppingStaleFrames() ? "dropped" : "presented in order") << std::endl;
+				}
+				else if (e.key.keysym.scancode == SDL_SCANCODE_F1)
+				{
+					pRenderer->ToggleFramePipelining();
+					std::cout << "Frame latency: " << pRenderer->GetFrameLatency() << (pRenderer->GetFrameLatency() > 0 ? " (pipelined)" : "") << std::endl;
+				}
+				else if (e.key.keysym.scancode == SDL_SCANCODE_F2)
+				{
+					pRenderer->ToggleLazyClear();
+					std::cout << "Clear: " << (pRenderer->IsClearingLazily() ? "per tile while rasterizing" : "full framebuffer up front") << std::endl;
+				}
+				else if (e.key.keysym.scancode == SDL_SCANCODE_F8)
+					printStatistics = !printStatistics;
+				else if (e.key.keysym.scancode == SDL_SCANCODE_F10)
+					SaveProfile();
+				else if (e.key.keysym.scancode == SDL_SCANCODE_F9)
+				{
+					isRecording = !isRecording;
+					if (isRecording)
+					{
+						recordedPath.Clear();
+						recordTime = 0.f;
+						recordKeyTimer = recordKeyInterval;
+						std::cout << "Recording camera path..." << std::endl;
+					}
+					else if (recordedPath.SaveToFile("Rasterizer_CameraPath.txt"))
+						std::cout << "Camera path saved!" << std::endl;
+					else
+						std::cout << "Something went wrong. Camera path not saved!" << std::endl;
+				}
 
 				break;
 			}
@@ -82,13 +283,55 @@ int main(int argc, char* args[])
 		//--------- Render ---------
 		pRenderer->Render();
 
+		if (pRenderer->IsUsingDynamicResolution())
+			std::cout << "Resolution scale: " << pRenderer->GetResolutionScale()
+				<< " (" << pRenderer->GetRenderWidth() << "x" << pRenderer->GetRenderHeight() << ")" << std::endl;
+
 		//--------- Timer ---------
 		pTimer->Update();
+
+		if (isRecording)
+		{
+			recordKeyTimer += pTimer->GetElapsed();
+			if (recordKeyTimer >= recordKeyInterval)
+			{
+				recordKeyTimer = 0.f;
+				const Camera& camera{ pRenderer->GetCamera() };
+				recordedPath.AddKey({ recordTime, camera.origin, camera.totalPitch, camera.totalYaw, pRenderer->GetMeshYaw() });
+			}
+			recordTime += pTimer->GetElapsed();
+		}
 		printTimer += pTimer->GetElapsed();
 		if (printTimer >= 1.f)
 		{
 			printTimer = 0.f;
 			std::cout << "dFPS: " << pTimer->GetdFPS() << std::endl;
+
+			if (printStatistics)
+			{
+				const Renderer::PipelineStatistics& statistics{ pRenderer->GetPipelineStatistics() };
+				std::cout << "  instances: " << statistics.instancesSubmitted
+					<< " (frustum culled " << statistics.instancesFrustumCulled << ", occluded " << statistics.instancesOccluded
+					<< ", occluder triangles " << statistics.occluderTriangles << ")"
+					<< " | shadow map triangles: " << statistics.shadowMapTriangles
+					<< " | lights: " << statistics.lightsSubmitted
+					<< " (culled " << statistics.lightsCulled << ", tile entries " << statistics.lightTileEntries
+					<< ", per fragment " << (statistics.shaderInvocations > 0 ? static_cast<float>(statistics.lightEvaluations) / statistics.shaderInvocations : 0.f) << ")"
+					<< " | vertices: " << statistics.inputVertices
+					<< " | triangles: " << statistics.trianglesSubmitted
+					<< " (culled " << statistics.trianglesCulled << ", clipped " << statistics.trianglesClipped << ")"
+					<< " | pixels tested: " << statistics.boundingBoxPixelsTested
+					<< ", covered: " << statistics.pixelsCovered
+					<< " | depth pass/fail: " << statistics.depthTestsPassed << "/" << statistics.depthTestsFailed
+					<< " | shaded: " << statistics.shaderInvocations << " (+" << statistics.helperPixels << " helpers)"
+					<< ", 2x2/4x4 rate tiles: " << statistics.halfRateTiles << "/" << statistics.quarterRateTiles
+					<< " | unchanged tiles: " << statistics.tilesUnchanged
+					<< " | HiZ rejected triangles/blocks: " << statistics.hiZTrianglesRejected << "/" << statistics.hiZBlocksRejected
+					<< ", tests avoided: " << statistics.hiZPixelTestsAvoided
+					<< " | depth KB: " << statistics.depthBytes / 1024
+					<< " | overdraw: " << statistics.overdraw
+					<< " | dropped frames: " << pRenderer->GetNrDroppedFrames() << std::endl;
+			}
 		}
 
 		//Save screenshot after full render
@@ -103,6 +346,8 @@ int main(int argc, char* args[])
 	}
 	pTimer->Stop();
 
+	SaveProfile();
+
 	//Shutdown "framework"
 	delete pRenderer;
 	delete pTimer;